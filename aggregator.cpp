@@ -25,14 +25,445 @@
 #include "settings.h"
 #include "common/standard.h"
 #include "common/clustering.h"
+#include "common/steps.h"
 #include "dynamic.h"
 #include "extras.h"
 #include "aggregatorargs.h"
 
 #define EXT_OUTPUT ".persist"
-typedef map<NODE,int> FreqCluster;
+/** minimum number of pending nodes before they are counted */
+#define MIN_FOLD_SIZE 256
+
+// ------------------------------------------------------------------------------------------
+// Class: FreqCluster
+// ------------------------------------------------------------------------------------------
+
+/**
+ * Counts the number of step communities of a timeline containing each node. Nodes are 
+ * appended as each step is read, and counted by sorting them once they outnumber the 
+ * nodes already counted, so that memory stays proportional to the distinct nodes.
+ */
+class FreqCluster
+{
+public:
+	void add( const Cluster &cluster );
+	void fold();
+	void persistent( const int min_persist_steps, Cluster &persist_cluster ) const;
+	void clear();
+
+protected:
+	/** nodes not yet counted, with repeats */
+	vector<NODE_ID> m_pending;
+	/** the distinct nodes counted so far, in order, with their counts */
+	vector<NODE_ID> m_nodes;
+	vector<int> m_counts;
+};
+
 typedef vector<FreqCluster> FreqClustering;
 
+void FreqCluster::add( const Cluster &cluster )
+{
+	m_pending.insert( m_pending.end(), cluster.begin(), cluster.end() );
+	if( m_pending.size() >= max( m_nodes.size(), (size_t)MIN_FOLD_SIZE ) )
+	{
+		fold();
+	}
+}
+
+/**
+ * Counts the pending nodes by sorting them, and merges the counts into those so far.
+ */
+void FreqCluster::fold()
+{
+	if( m_pending.empty() )
+	{
+		return;
+	}
+	sort( m_pending.begin(), m_pending.end() );
+	vector<NODE_ID> nodes;
+	vector<int> counts;
+	nodes.reserve( m_nodes.size() + m_pending.size() );
+	counts.reserve( m_nodes.size() + m_pending.size() );
+	size_t i = 0, j = 0;
+	while( i < m_nodes.size() || j < m_pending.size() )
+	{
+		if( j == m_pending.size() || ( i < m_nodes.size() && m_nodes[i] < m_pending[j] ) )
+		{
+			nodes.push_back( m_nodes[i] );
+			counts.push_back( m_counts[i++] );
+			continue;
+		}
+		// a run of the same pending node, added to any count so far
+		NODE_ID node = m_pending[j];
+		int count = 0;
+		for( ; j < m_pending.size() && m_pending[j] == node; j++ )
+		{
+			count++;
+		}
+		if( i < m_nodes.size() && m_nodes[i] == node )
+		{
+			count += m_counts[i++];
+		}
+		nodes.push_back( node );
+		counts.push_back( count );
+	}
+	m_nodes.swap( nodes );
+	m_counts.swap( counts );
+	vector<NODE_ID>().swap( m_pending );
+}
+
+/**
+ * Finds the nodes in at least the given number of step communities, once the counts are folded.
+ */
+void FreqCluster::persistent( const int min_persist_steps, Cluster &persist_cluster ) const
+{
+	vector<NODE_ID> persist_nodes;
+	for( size_t i = 0; i < m_nodes.size(); i++ )
+	{
+		if( m_counts[i] >= min_persist_steps )
+		{
+			persist_nodes.push_back( m_nodes[i] );
+		}
+	}
+	persist_cluster.insert( persist_nodes.begin(), persist_nodes.end() );
+}
+
+void FreqCluster::clear()
+{
+	vector<NODE_ID>().swap( m_pending );
+	vector<NODE_ID>().swap( m_nodes );
+	vector<int>().swap( m_counts );
+}
+
+// ------------------------------------------------------------------------------------------
+// Class: StepCounter
+// ------------------------------------------------------------------------------------------
+
+/**
+ * Counts the nodes of the step communities of each timeline, one step at a time, on threads 
+ * created once for all steps. Each thread owns the timelines whose index is its number modulo 
+ * the number of threads, so the steps of each timeline are counted in order by one thread, 
+ * and is given the entries of the step index for its own timelines before counting starts.
+ */
+class StepCounter
+{
+public:
+	StepCounter( FreqClustering &fclustering, const StepIndex &step_index, const vector<char> &ignored, const int num_threads );
+	~StepCounter();
+
+	void count( const int step, const Clustering &step_clustering );
+	void finish();
+
+protected:
+	/** the entries of one thread, with the start of each step, from step 0 */
+	struct Slice
+	{
+		StepCounter* counter;
+		vector<uint64_t> offsets;
+		vector<int> clusters;
+		vector<int> timelines;
+		/** the last step counted */
+		unsigned long generation;
+	};
+
+	static void* run_worker( void* arg );
+	void count_slice( const Slice &slice, const int step, const Clustering &step_clustering );
+
+	FreqClustering& m_fclustering;
+	vector<Slice> m_slices;
+	vector<pthread_t> m_workers;
+	pthread_mutex_t m_lock;
+	pthread_cond_t m_changed;
+	/** the step being counted, and its step communities, which must stay alive until the next call */
+	int m_step;
+	const Clustering* m_step_clustering;
+	/** number of steps handed to the threads so far */
+	unsigned long m_generation;
+	/** number of threads still counting the latest step */
+	int m_busy;
+	bool m_finished;
+};
+
+StepCounter::StepCounter( FreqClustering &fclustering, const StepIndex &step_index, const vector<char> &ignored, const int num_threads )
+	: m_fclustering(fclustering), m_step(0), m_step_clustering(NULL), m_generation(0), m_busy(0), m_finished(false)
+{
+	int used_threads = max( 1, min( num_threads, (int)fclustering.size() ) );
+	int num_steps = step_index.max_step() + 1;
+	m_slices.resize( used_threads );
+	for( int t = 0; t < used_threads; t++ )
+	{
+		m_slices[t].counter = this;
+		m_slices[t].offsets.assign( num_steps + 1, 0 );
+		m_slices[t].generation = 0;
+	}
+	// count the entries of each thread in each step, then share out the entries in their order
+	for( int step = 0; step < num_steps; step++ )
+	{
+		for( size_t entry = step_index.begin(step); entry < step_index.end(step); entry++ )
+		{
+			int dyn_index = step_index.timeline(entry);
+			if( !ignored[dyn_index] )
+			{
+				m_slices[dyn_index % used_threads].offsets[step+1]++;
+			}
+		}
+	}
+	for( int t = 0; t < used_threads; t++ )
+	{
+		Slice& slice = m_slices[t];
+		for( int step = 0; step < num_steps; step++ )
+		{
+			slice.offsets[step+1] += slice.offsets[step];
+		}
+		slice.clusters.reserve( slice.offsets[num_steps] );
+		slice.timelines.reserve( slice.offsets[num_steps] );
+	}
+	for( size_t entry = 0; entry < step_index.end( num_steps - 1 ); entry++ )
+	{
+		int dyn_index = step_index.timeline(entry);
+		if( !ignored[dyn_index] )
+		{
+			m_slices[dyn_index % used_threads].clusters.push_back( step_index.cluster(entry) );
+			m_slices[dyn_index % used_threads].timelines.push_back( dyn_index );
+		}
+	}
+	pthread_mutex_init( &m_lock, NULL );
+	pthread_cond_init( &m_changed, NULL );
+	if( used_threads > 1 )
+	{
+		m_workers.resize( used_threads );
+		for( int t = 0; t < used_threads; t++ )
+		{
+			pthread_create( &m_workers[t], NULL, StepCounter::run_worker, &m_slices[t] );
+		}
+	}
+}
+
+StepCounter::~StepCounter()
+{
+	finish();
+	pthread_cond_destroy( &m_changed );
+	pthread_mutex_destroy( &m_lock );
+}
+
+/**
+ * Hands a step to the threads, once they have counted the previous step, and returns 
+ * without waiting for them, so that the next step can be read in the meantime.
+ */
+void StepCounter::count( const int step, const Clustering &step_clustering )
+{
+	if( m_workers.empty() )
+	{
+		count_slice( m_slices[0], step, step_clustering );
+		return;
+	}
+	pthread_mutex_lock( &m_lock );
+	while( m_busy > 0 )
+	{
+		pthread_cond_wait( &m_changed, &m_lock );
+	}
+	m_step = step;
+	m_step_clustering = &step_clustering;
+	m_generation++;
+	m_busy = (int)m_workers.size();
+	pthread_cond_broadcast( &m_changed );
+	pthread_mutex_unlock( &m_lock );
+}
+
+/**
+ * Waits for the threads to count the last step, and stops them.
+ */
+void StepCounter::finish()
+{
+	if( m_workers.empty() )
+	{
+		return;
+	}
+	pthread_mutex_lock( &m_lock );
+	while( m_busy > 0 )
+	{
+		pthread_cond_wait( &m_changed, &m_lock );
+	}
+	m_finished = true;
+	pthread_cond_broadcast( &m_changed );
+	pthread_mutex_unlock( &m_lock );
+	for( size_t t = 0; t < m_workers.size(); t++ )
+	{
+		pthread_join( m_workers[t], NULL );
+	}
+	m_workers.clear();
+}
+
+void* StepCounter::run_worker( void* arg )
+{
+	Slice* slice = (Slice*)arg;
+	StepCounter* counter = slice->counter;
+	pthread_mutex_lock( &counter->m_lock );
+	while( true )
+	{
+		while( slice->generation == counter->m_generation && !counter->m_finished )
+		{
+			pthread_cond_wait( &counter->m_changed, &counter->m_lock );
+		}
+		if( slice->generation == counter->m_generation )
+		{
+			break;
+		}
+		slice->generation = counter->m_generation;
+		int step = counter->m_step;
+		const Clustering* step_clustering = counter->m_step_clustering;
+		pthread_mutex_unlock( &counter->m_lock );
+		counter->count_slice( *slice, step, *step_clustering );
+		pthread_mutex_lock( &counter->m_lock );
+		counter->m_busy--;
+		pthread_cond_broadcast( &counter->m_changed );
+	}
+	pthread_mutex_unlock( &counter->m_lock );
+	return NULL;
+}
+
+void StepCounter::count_slice( const Slice &slice, const int step, const Clustering &step_clustering )
+{
+	if( step + 1 >= (int)slice.offsets.size() )
+	{
+		return;
+	}
+	for( uint64_t entry = slice.offsets[step]; entry < slice.offsets[step+1]; entry++ )
+	{
+		// process the step cluster in this timeline
+		int step_cluster_index = slice.clusters[entry] - 1;
+		m_fclustering[slice.timelines[entry]].add( step_clustering[step_cluster_index] );
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+// Persistent communities
+// ------------------------------------------------------------------------------------------
+
+/**
+ * Runs each task on its own thread, or on this thread when there is only one task.
+ */
+template<class Task> static void run_tasks( void* (*work)(void*), vector<Task> &tasks )
+{
+	if( tasks.size() == 1 )
+	{
+		work( &tasks[0] );
+		return;
+	}
+	vector<pthread_t> threads( tasks.size() );
+	for( size_t t = 0; t < tasks.size(); t++ )
+	{
+		pthread_create( &threads[t], NULL, work, &tasks[t] );
+	}
+	for( size_t t = 0; t < tasks.size(); t++ )
+	{
+		pthread_join( threads[t], NULL );
+	}
+}
+
+/** the share of the timelines thresholded by one thread */
+struct PersistTask
+{
+	FreqClustering* fclustering;
+	vector<Clustering>* persist_clusterings;
+	const vector<char>* ignored;
+	const vector<int>* min_persist_steps;
+	int first;
+	int stride;
+};
+
+static void* persist_thread( void* arg )
+{
+	PersistTask* task = (PersistTask*)arg;
+	int count = (int)task->fclustering->size();
+	for( int dyn_index = task->first; dyn_index < count; dyn_index += task->stride )
+	{
+		if( (*task->ignored)[dyn_index] )
+		{
+			continue;
+		}
+		FreqCluster& fcluster = (*task->fclustering)[dyn_index];
+		fcluster.fold();
+		for( size_t k = 0; k < task->min_persist_steps->size(); k++ )
+		{
+			fcluster.persistent( (*task->min_persist_steps)[k], (*task->persist_clusterings)[k][dyn_index] );
+		}
+		fcluster.clear();
+	}
+	return NULL;
+}
+
+/**
+ * Converts the counts of every timeline to a persistent community for each minimum number 
+ * of steps. Each timeline is independent, so the timelines are shared between the threads in turn.
+ */
+static void find_persistent( FreqClustering &fclustering, const vector<char> &ignored, const vector<int> &min_persist_steps, const int num_threads, vector<Clustering> &persist_clusterings )
+{
+	int used_threads = max( 1, min( num_threads, (int)fclustering.size() ) );
+	vector<PersistTask> tasks( used_threads );
+	for( int t = 0; t < used_threads; t++ )
+	{
+		tasks[t].fclustering = &fclustering;
+		tasks[t].persist_clusterings = &persist_clusterings;
+		tasks[t].ignored = &ignored;
+		tasks[t].min_persist_steps = &min_persist_steps;
+		tasks[t].first = t;
+		tasks[t].stride = used_threads;
+	}
+	run_tasks( persist_thread, tasks );
+}
+
+/**
+ * Parses a comma-separated list of persistence thresholds, keeping the text of each as its label.
+ */
+static bool parse_thresholds( const char* text, vector<double> &thresholds, vector<string> &labels )
+{
+	string remaining( text );
+	while( true )
+	{
+		size_t pos = remaining.find( ',' );
+		string label = remaining.substr( 0, pos );
+		char* end = NULL;
+		double threshold = strtod( label.c_str(), &end );
+		if( label.empty() || *end != 0 || threshold < 0 || threshold > 1 )
+		{
+			cerr << "Error: Invalid persistence threshold value: " << label << ". Value should be between 0 and 1." << endl;
+			return false;
+		}
+		thresholds.push_back( threshold );
+		labels.push_back( label );
+		if( pos == string::npos )
+		{
+			return true;
+		}
+		remaining = remaining.substr( pos + 1 );
+	}
+}
+
+/**
+ * Removes small and duplicate persistent communities, and writes the remainder to the given file.
+ */
+static bool write_persistent( const string& fname, Clustering &persist_clustering, const int num_ignored )
+{
+	int removed = remove_small_clusters(persist_clustering) - num_ignored;
+	if( removed > 0 )
+	{
+		cout << "Removed " << removed << " group(s) of size < " << MIN_CLUSTER_SIZE  << endl;
+	}
+	removed = remove_duplicate_clusters(persist_clustering);
+	if( removed > 0 )
+	{
+		cout << "Removed " << removed << " duplicate group(s)" << endl;
+	}
+	cout << "Writing " <<  persist_clustering.size() << " persistent communities to " << fname << endl;
+	if( !write_clustering(fname, DEFAULT_DELIM, persist_clustering) )
+	{
+		cerr << "Error: Cannot write file " << fname << endl;
+		return false;
+	}
+	return true;
+}
+
 int main(int argc, char *argv[])
 {
 	/// Parse command line arguments
@@ -41,7 +472,25 @@ int main(int argc, char *argv[])
 	{
 		exit(1);
 	}
-	int supplied_steps = args_info.inputs_num;
+	StepSource steps;
+	if( args_info.archive_arg != NULL && strlen(args_info.archive_arg) > 0 )
+	{
+		if( args_info.inputs_num > 0 )
+		{
+			cerr << "Error: Step communities should be specified either as files or as an archive, not both" << endl;
+			exit(1);
+		}
+		if( !steps.open_archive( string(args_info.archive_arg) ) )
+		{
+			cerr << "Error: Failed to open step archive " << args_info.archive_arg << endl;
+			exit(1);
+		}
+	}
+	else
+	{
+		steps.set_files( args_info.inputs_num, args_info.inputs );
+	}
+	int supplied_steps = steps.size();
 	if( supplied_steps < 1 )
 	{
 		cerr << "Error: At least one file containing step communities should be specified" << endl;
@@ -62,19 +511,36 @@ int main(int argc, char *argv[])
 	{
 		prefix = string(args_info.output_arg);
 	}
-	double persist_threshold = args_info.persist_arg;
-	if( persist_threshold < 0 || persist_threshold > 1 )
+	// a list of thresholds also gives the union, the same as the threshold 0
+	vector<double> thresholds;
+	vector<string> labels;
+	if( args_info.persist_arg == NULL )
+	{
+		thresholds.push_back( 0 );
+		labels.push_back( "union" );
+	}
+	else if( !parse_thresholds( args_info.persist_arg, thresholds, labels ) )
 	{
-		cerr << "Error: Invalid persistence threshold value: " << persist_threshold << ". Value should be between 0 and 1." << endl;
 		exit(1);
 	}
-	bool use_union = (persist_threshold == 0 );
+	if( thresholds.size() > 1 && find( thresholds.begin(), thresholds.end(), 0.0 ) == thresholds.end() )
+	{
+		thresholds.push_back( 0 );
+		labels.push_back( "union" );
+	}
+	bool use_union = ( thresholds.size() == 1 && thresholds[0] == 0 );
+	int num_threads = args_info.threads_arg;
+	if( num_threads < 1 )
+	{
+		cerr << "Error: Invalid number of threads: " << num_threads << endl;
+		exit(1);
+	}
 	int user_max_step = args_info.max_arg;
 	int min_persist_length = args_info.length_arg;
 	string timeline_fname = string(args_info.input_arg);
 
 	/// Read timeline
-	vector<Timeline> timelines;
+	TimelineStore timelines;
 	int limit_max_step;
 	cout << "* Loading timelines from " << timeline_fname << endl;
 	if( !read_timelines( timeline_fname, timelines, limit_max_step ) )
@@ -83,6 +549,25 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 	cout << "Read " << timelines.size() << " dynamic community timelines" << endl;
+	/// Index the timelines by step
+	StepIndex step_index;
+	string index_fname = timeline_fname + ".stepindex";
+	if( args_info.index_given && step_index.read( index_fname, timeline_fname, timelines ) )
+	{
+		cout << "* Read step index from " << index_fname << endl;
+	}
+	else
+	{
+		step_index.build( timelines );
+		if( args_info.index_given )
+		{
+			cout << "* Writing step index to " << index_fname << endl;
+			if( !step_index.write( index_fname, timeline_fname ) )
+			{
+				cerr << "Warning: Cannot write file " << index_fname << endl;
+			}
+		}
+	}
 	int max_step;
 	if( user_max_step > 0 && user_max_step < limit_max_step )
 	{
@@ -117,24 +602,25 @@ int main(int argc, char *argv[])
 	}
 	
 	/// Filter irrelevant timelines
-	Clustering persist_clustering;
-	set<int> ignore_dynamic_indices;
+	// one clustering per threshold, with an empty cluster for every timeline
+	vector<Clustering> persist_clusterings( thresholds.size(), Clustering( timelines.size() ) );
+	vector<char> ignored( timelines.size(), 0 );
+	int num_ignored = 0;
 	int filter_size = 0, filter_time = 0, filter_dead;
 	for( int dyn_index = 0; dyn_index < timelines.size(); dyn_index++ )
 	{
-		// add an empty cluster anyway
-		Cluster persist_cluster;
-		persist_clustering.push_back(persist_cluster);
 		// too short?
 		if( timelines[dyn_index].size() < min_persist_length )
 		{
-			ignore_dynamic_indices.insert(dyn_index);
+			ignored[dyn_index] = 1;
+			num_ignored++;
 			filter_size++;
 		}
 		// outside our time window?
 		else if( timelines[dyn_index].first_observed() > max_step )
 		{
-			ignore_dynamic_indices.insert(dyn_index);
+			ignored[dyn_index] = 1;
+			num_ignored++;
 			filter_time++;
 		}
 	}
@@ -155,125 +641,88 @@ int main(int argc, char *argv[])
 		{
 			int step = i+1;
 			// Read the step clustering
-			string fname(args_info.inputs[i]);
-			ifstream in(args_info.inputs[i]);
-			if(in.is_open() == false) 
-			{
-				cerr << "Error: Step communities file "<<fname<<" not found"<< endl;
-				return -1;
-			}
+			string fname = steps.name(step);
 			cout << "* Loading step " << step << "/" << max_step << " from " << fname << " ..." << endl;
 			Clustering step_clustering;
-			if( !read_clustering( fname, DEFAULT_DELIM, step_clustering ) )
+			if( !steps.read( step, step_clustering ) )
 			{
-				cerr << "Error: Failed to read communities from file " << fname << endl;
+				cerr << "Error: Failed to read communities from " << fname << endl;
 				return -1;
 			}
 			cout << "Found " << step_clustering.size() << " non-empty step communities" << endl;
-			// Update the set of persistent communities
-			for( int dyn_index = 0; dyn_index < timelines.size(); dyn_index++ )
+			if( !step_index.in_range( step, step_clustering.size() ) )
+			{
+				cerr << "Error: Timelines refer to step communities missing from " << fname << endl;
+				return -1;
+			}
+			// Update the set of persistent communities from the timelines observed in this step
+			for( size_t entry = step_index.begin(step); entry < step_index.end(step); entry++ )
 			{
+				int dyn_index = step_index.timeline(entry);
 				// ignore this timeline?
-				if( ignore_dynamic_indices.count(dyn_index) )
+				if( ignored[dyn_index] )
 				{
 					continue;
 				}
 				// process the step cluster in this timeline
-				int step_cluster_index = timelines[dyn_index][step] - 1;
-				if( step_cluster_index >= 0 )
-				{
-					persist_clustering[dyn_index].insert(step_clustering[step_cluster_index].begin(), step_clustering[step_cluster_index].end());
-				}
+				int step_cluster_index = step_index.cluster(entry) - 1;
+				persist_clusterings[0][dyn_index].insert(step_clustering[step_cluster_index].begin(), step_clustering[step_cluster_index].end());
 			}
 		}
 	}
 	else
 	{
-		int min_persist_steps = max(1, (int)round(persist_threshold*max_step) );
-		cout << "* Constructing persistent communities for nodes appearing in >= " << min_persist_steps << " associated step communities ..." << endl;
-		// Create frequency maps for each timeline using info from each step
-		FreqClustering fclustering;
-		for( int dyn_index = 0; dyn_index < timelines.size(); dyn_index++ )
+		// the union holds the nodes appearing in any associated step community
+		vector<int> min_persist_steps;
+		for( size_t k = 0; k < thresholds.size(); k++ )
 		{
-			FreqCluster fcluster;
-			fclustering.push_back(fcluster);
+			min_persist_steps.push_back( max(1, (int)round(thresholds[k]*max_step) ) );
+			cout << "* Constructing persistent communities for nodes appearing in >= " << min_persist_steps[k] << " associated step communities ..." << endl;
 		}
+		// Count node memberships for each timeline using info from each step, reading each step 
+		// into one buffer while the threads may still be counting the previous step in the other
+		FreqClustering fclustering( timelines.size() );
+		Clustering step_buffers[2];
+		StepCounter counter( fclustering, step_index, ignored, num_threads );
 		for ( int i = 0; i < max_step; ++i )
 		{
 			int step = i+1;
 			// Read the step clustering
-			string fname(args_info.inputs[i]);
-			ifstream in(args_info.inputs[i]);
-			if(in.is_open() == false) 
-			{
-				cerr << "Error: Step communities file "<<fname<<" not found"<< endl;
-				return -1;
-			}
+			string fname = steps.name(step);
 			cout << "* Loading step " << step << "/" << max_step << " from " << fname << " ..." << endl;
-			Clustering step_clustering;
-			if( !read_clustering( fname, DEFAULT_DELIM, step_clustering ) )
+			Clustering& step_clustering = step_buffers[i % 2];
+			if( !steps.read( step, step_clustering ) )
 			{
-				cerr << "Error: Failed to read communities from file " << fname << endl;
+				cerr << "Error: Failed to read communities from " << fname << endl;
 				return -1;
 			}
 			cout << "Found " << step_clustering.size() << " non-empty step communities" << endl;
-			// Update the set of persistent communities
-			for( int dyn_index = 0; dyn_index < timelines.size(); dyn_index++ )
+			if( !step_index.in_range( step, step_clustering.size() ) )
 			{
-				// ignore this timeline?
-				if( ignore_dynamic_indices.count(dyn_index) )
-				{
-					continue;
-				}
-				// process the step cluster in this timeline
-				int step_cluster_index = timelines[dyn_index][step] - 1;
-				if( step_cluster_index >= 0 )
-				{
-					for( Cluster::const_iterator it = step_clustering[step_cluster_index].begin(); it != step_clustering[step_cluster_index].end(); it++ )
-					{
-						NODE node = *it;
-						fclustering[dyn_index][node] += 1;
-					}
-				}
-			}
-		}
-		// Now convert frequency maps to an actual clustering
-		for( int dyn_index = 0; dyn_index < timelines.size(); dyn_index++ )
-		{
-			// ignore this timeline?
-			if( ignore_dynamic_indices.count(dyn_index) )
-			{
-				continue;
-			}
-			for( FreqCluster::const_iterator it = fclustering[dyn_index].begin(); it != fclustering[dyn_index].end(); it++ )
-			{
-				if( (*it).second >= min_persist_steps )
-				{
-					persist_clustering[dyn_index].insert((*it).first);
-				}
+				cerr << "Error: Timelines refer to step communities missing from " << fname << endl;
+				return -1;
 			}
+			// Count the nodes of the timelines observed in this step
+			counter.count( step, step_clustering );
 		}
+		counter.finish();
+		// Now convert the counts to an actual clustering
+		find_persistent( fclustering, ignored, min_persist_steps, num_threads, persist_clusterings );
 	}
 
-	/// Remove any irrelevant persistent clusters
-	int removed = remove_small_clusters(persist_clustering) - ignore_dynamic_indices.size();
-	if( removed > 0 )
+	/// Remove any irrelevant persistent clusters and write out, labelling the files when there are several
+	for( size_t k = 0; k < thresholds.size(); k++ )
 	{
-		cout << "Removed " << removed << " group(s) of size < " << MIN_CLUSTER_SIZE  << endl;
-	}
-	removed = remove_duplicate_clusters(persist_clustering);
-	if( removed > 0 )
-	{
-		cout << "Removed " << removed << " duplicate group(s)" << endl;
-	}
-	
-	/// Write out
-	string fname = prefix + EXT_OUTPUT;
-	cout << "Writing " <<  persist_clustering.size() << " persistent communities to " << fname << endl;
-	if( !write_clustering(fname, DEFAULT_DELIM, persist_clustering) )
-	{
-		cerr << "Error: Cannot write file " << fname << endl;
-		return -1;
+		string fname = prefix + EXT_OUTPUT;
+		if( thresholds.size() > 1 )
+		{
+			fname = prefix + "." + ( thresholds[k] == 0 ? string("union") : labels[k] ) + EXT_OUTPUT;
+		}
+		if( !write_persistent( fname, persist_clusterings[k], num_ignored ) )
+		{
+			return -1;
+		}
+		Clustering().swap( persist_clusterings[k] );
 	}
 	
 	cout << "Done." << endl;
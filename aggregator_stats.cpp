@@ -24,6 +24,7 @@
 #include "settings.h"
 #include "common/standard.h"
 #include "common/clustering.h"
+#include "common/steps.h"
 #include "settings.h"
 #include "dynamic.h"
 #include "extras.h"
@@ -37,7 +38,25 @@ int main(int argc, char *argv[])
 	{
 		exit(1);
 	}
-	int supplied_steps = args_info.inputs_num;
+	StepSource steps;
+	if( args_info.archive_arg != NULL && strlen(args_info.archive_arg) > 0 )
+	{
+		if( args_info.inputs_num > 0 )
+		{
+			cerr << "Error: Step communities should be specified either as files or as an archive, not both" << endl;
+			exit(1);
+		}
+		if( !steps.open_archive( string(args_info.archive_arg) ) )
+		{
+			cerr << "Error: Failed to open step archive " << args_info.archive_arg << endl;
+			exit(1);
+		}
+	}
+	else
+	{
+		steps.set_files( args_info.inputs_num, args_info.inputs );
+	}
+	int supplied_steps = steps.size();
 	if( supplied_steps < 1 )
 	{
 		cerr << "Error: At least one file containing step communities should be specified" << endl;
@@ -54,7 +73,7 @@ int main(int argc, char *argv[])
 	string timeline_fname = string(args_info.input_arg);
 	
 	/// Read timeline
-	vector<Timeline> timelines;
+	TimelineStore timelines;
 	int limit_max_step;
 	cout << "* Loading timelines from " << timeline_fname << endl;
 	if( !read_timelines( timeline_fname, timelines, limit_max_step ) )
@@ -63,6 +82,25 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 	cout << "Read " << timelines.size() << " dynamic community timelines" << endl;
+	/// Index the timelines by step
+	StepIndex step_index;
+	string index_fname = timeline_fname + ".stepindex";
+	if( args_info.index_given && step_index.read( index_fname, timeline_fname, timelines ) )
+	{
+		cout << "* Read step index from " << index_fname << endl;
+	}
+	else
+	{
+		step_index.build( timelines );
+		if( args_info.index_given )
+		{
+			cout << "* Writing step index to " << index_fname << endl;
+			if( !step_index.write( index_fname, timeline_fname ) )
+			{
+				cerr << "Warning: Cannot write file " << index_fname << endl;
+			}
+		}
+	}
 	int max_step;
 	if( user_max_step > 0 && user_max_step < limit_max_step )
 	{
@@ -86,7 +124,8 @@ int main(int argc, char *argv[])
 	/// Filter irrelevant communities
 	Clustering union_clustering;
 	vector<int> lengths;
-	set<int> ignore_dynamic_indices;
+	vector<char> ignored( timelines.size(), 0 );
+	int num_ignored = 0;
 	int filter_size = 0, filter_time = 0, filter_dead;
 	for( int dyn_index = 0; dyn_index < timelines.size(); dyn_index++ )
 	{
@@ -97,12 +136,14 @@ int main(int argc, char *argv[])
 		// too short?
 		if( timelines[dyn_index].size() < min_persist_length )
 		{
-			ignore_dynamic_indices.insert(dyn_index);
+			ignored[dyn_index] = 1;
+			num_ignored++;
 			filter_size++;
 		}
 		else if( timelines[dyn_index].first_observed() > max_step )
 		{
-			ignore_dynamic_indices.insert(dyn_index);
+			ignored[dyn_index] = 1;
+			num_ignored++;
 			filter_time++;
 		}
 	}
@@ -116,7 +157,6 @@ int main(int argc, char *argv[])
 	}
 	
 	/// Process each set of step communities
-	vector<Timeline>::iterator timeit;
 	if( supplied_steps < max_step )
 	{
 		cerr << "Error: incorrect number of step files specified (" << supplied_steps << " < " << max_step << ")" << endl;
@@ -129,42 +169,39 @@ int main(int argc, char *argv[])
 	for ( int i = 0; i < max_step; ++i )
 	{
 		int step = i+1;
-		string fname(args_info.inputs[i]);
-		ifstream in(args_info.inputs[i]);
-		if(in.is_open() == false) 
-		{
-			cerr << "Error: Step communities file "<<fname<<" not found"<< endl;
-			return -1;
-		}
+		string fname = steps.name(step);
 		cout << "* Loading step " << step << "/" << max_step << " from " << fname << " ..." << endl;
 		Clustering step_clustering;
-		if( !read_clustering( fname, DEFAULT_DELIM, step_clustering ) )
+		if( !steps.read( step, step_clustering ) )
 		{
-			cerr << "Error: Failed to read communities from file " << fname << endl;
+			cerr << "Error: Failed to read communities from " << fname << endl;
 			return -1;
 		}
 		cout << "Found " << step_clustering.size() << " non-empty step communities" << endl;
-		// create the set
-		for( int dyn_index = 0; dyn_index < timelines.size(); dyn_index++ )
+		if( !step_index.in_range( step, step_clustering.size() ) )
+		{
+			cerr << "Error: Timelines refer to step communities missing from " << fname << endl;
+			return -1;
+		}
+		// create the set from the timelines observed in this step
+		for( size_t entry = step_index.begin(step); entry < step_index.end(step); entry++ )
 		{
+			int dyn_index = step_index.timeline(entry);
 			// ignore?
-			if( ignore_dynamic_indices.count(dyn_index) )
+			if( ignored[dyn_index] )
 			{
 				continue;
 			}
-			int step_cluster_index = timelines[dyn_index][step] - 1;
-			if( step_cluster_index >= 0 )
-			{
-				union_clustering[dyn_index].insert(step_clustering[step_cluster_index].begin(), step_clustering[step_cluster_index].end());
-			}
+			int step_cluster_index = step_index.cluster(entry) - 1;
+			union_clustering[dyn_index].insert(step_clustering[step_cluster_index].begin(), step_clustering[step_cluster_index].end());
 		}
 	}
 	
-	printf("Found %d total dynamic communities. Ignoring %d dynamic communities.\n", (int)timelines.size(), (int)ignore_dynamic_indices.size() );
+	printf("Found %d total dynamic communities. Ignoring %d dynamic communities.\n", (int)timelines.size(), num_ignored );
 	for( int dyn_index = 0; dyn_index < timelines.size(); dyn_index++ )
 	{
 		// ignore?
-		if( ignore_dynamic_indices.count(dyn_index) )
+		if( ignored[dyn_index] )
 		{
 			continue;
 		}
@@ -28,11 +28,13 @@ const char *aggregator_stats_args_info_usage = "Usage: aggregator_stats [OPTIONS
 const char *aggregator_stats_args_info_description = "Dynamic community timeline aggregator stats tool";
 
 const char *aggregator_stats_args_info_help[] = {
-  "  -h, --help            Print help and exit",
-  "  -V, --version         Print version and exit",
-  "  -i, --input=FILEPATH  input timeline file",
-  "  -m, --max=INT         maximum time step to process (by default process all \n                          step communities specified)",
-  "  -l, --length=INT      minimum length (number of time steps) for a dynamic \n                          cluster to be deemed persistent (default=2)",
+  "  -h, --help              Print help and exit",
+  "  -V, --version           Print version and exit",
+  "  -i, --input=FILEPATH    input timeline file",
+  "  -m, --max=INT           maximum time step to process (by default process all \n                            step communities specified)",
+  "  -l, --length=INT        minimum length (number of time steps) for a dynamic \n                            cluster to be deemed persistent (default=2)",
+  "  -a, --archive=FILEPATH  step community archive created by the pack tool, used \n                            instead of STEP_COMMUNITIES",
+  "  -x, --index             keep a reverse index of the timelines by step in the \n                            file INPUT.stepindex, reading it if it matches the \n                            timelines and writing it otherwise",
     0
 };
 
@@ -62,6 +64,8 @@ void clear_given (struct aggregator_stats_args_info *args_info)
   args_info->input_given = 0 ;
   args_info->max_given = 0 ;
   args_info->length_given = 0 ;
+  args_info->archive_given = 0 ;
+  args_info->index_given = 0 ;
 }
 
 static
@@ -71,6 +75,8 @@ void clear_args (struct aggregator_stats_args_info *args_info)
   args_info->input_orig = NULL;
   args_info->max_orig = NULL;
   args_info->length_orig = NULL;
+  args_info->archive_arg = NULL;
+  args_info->archive_orig = NULL;
   
 }
 
@@ -84,6 +90,8 @@ void init_args_info(struct aggregator_stats_args_info *args_info)
   args_info->input_help = aggregator_stats_args_info_help[2] ;
   args_info->max_help = aggregator_stats_args_info_help[3] ;
   args_info->length_help = aggregator_stats_args_info_help[4] ;
+  args_info->archive_help = aggregator_stats_args_info_help[5] ;
+  args_info->index_help = aggregator_stats_args_info_help[6] ;
   
 }
 
@@ -169,6 +177,8 @@ cmdline_parser_release (struct aggregator_stats_args_info *args_info)
   free_string_field (&(args_info->input_orig));
   free_string_field (&(args_info->max_orig));
   free_string_field (&(args_info->length_orig));
+  free_string_field (&(args_info->archive_arg));
+  free_string_field (&(args_info->archive_orig));
   
   
   for (i = 0; i < args_info->inputs_num; ++i)
@@ -213,6 +223,10 @@ cmdline_parser_dump(FILE *outfile, struct aggregator_stats_args_info *args_info)
     write_into_file(outfile, "max", args_info->max_orig, 0);
   if (args_info->length_given)
     write_into_file(outfile, "length", args_info->length_orig, 0);
+  if (args_info->archive_given)
+    write_into_file(outfile, "archive", args_info->archive_orig, 0);
+  if (args_info->index_given)
+    write_into_file(outfile, "index", 0, 0 );
   
 
   i = EXIT_SUCCESS;
@@ -462,10 +476,12 @@ cmdline_parser_internal (int argc, char * const *argv, struct aggregator_stats_a
         { "input",	1, NULL, 'i' },
         { "max",	1, NULL, 'm' },
         { "length",	1, NULL, 'l' },
+        { "archive",	1, NULL, 'a' },
+        { "index",	0, NULL, 'x' },
         { NULL,	0, NULL, 0 }
       };
 
-      c = getopt_long (argc, argv, "hVi:m:l:", long_options, &option_index);
+      c = getopt_long (argc, argv, "hVi:m:l:a:x", long_options, &option_index);
 
       if (c == -1) break;	/* Exit from `while (1)' loop.  */
 
@@ -517,6 +533,30 @@ cmdline_parser_internal (int argc, char * const *argv, struct aggregator_stats_a
             goto failure;
         
           break;
+        case 'a':	/* step community archive created by the pack tool, used instead of STEP_COMMUNITIES.  */
+        
+        
+          if (update_arg( (void *)&(args_info->archive_arg), 
+               &(args_info->archive_orig), &(args_info->archive_given),
+              &(local_args_info.archive_given), optarg, 0, 0, ARG_STRING,
+              check_ambiguity, override, 0, 0,
+              "archive", 'a',
+              additional_error))
+            goto failure;
+        
+          break;
+        case 'x':	/* keep a reverse index of the timelines by step in the file INPUT.stepindex, reading it if it matches the timelines and writing it otherwise.  */
+        
+        
+          if (update_arg( 0 , 
+               0 , &(args_info->index_given),
+              &(local_args_info.index_given), optarg, 0, 0, ARG_NO,
+              check_ambiguity, override, 0, 0,
+              "index", 'x',
+              additional_error))
+            goto failure;
+        
+          break;
 
         case 0:	/* Long option with no short option */
         case '?':	/* Invalid option.  */
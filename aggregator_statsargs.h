@@ -43,12 +43,18 @@ struct aggregator_stats_args_info
   int length_arg;	/**< @brief minimum length (number of time steps) for a dynamic cluster to be deemed persistent (default=2).  */
   char * length_orig;	/**< @brief minimum length (number of time steps) for a dynamic cluster to be deemed persistent (default=2) original value given at command line.  */
   const char *length_help; /**< @brief minimum length (number of time steps) for a dynamic cluster to be deemed persistent (default=2) help description.  */
+  char * archive_arg;	/**< @brief step community archive created by the pack tool, used instead of STEP_COMMUNITIES.  */
+  char * archive_orig;	/**< @brief step community archive created by the pack tool, used instead of STEP_COMMUNITIES original value given at command line.  */
+  const char *archive_help; /**< @brief step community archive created by the pack tool, used instead of STEP_COMMUNITIES help description.  */
+  const char *index_help; /**< @brief keep a reverse index of the timelines by step in the file INPUT.stepindex, reading it if it matches the timelines and writing it otherwise help description.  */
   
   unsigned int help_given ;	/**< @brief Whether help was given.  */
   unsigned int version_given ;	/**< @brief Whether version was given.  */
   unsigned int input_given ;	/**< @brief Whether input was given.  */
   unsigned int max_given ;	/**< @brief Whether max was given.  */
   unsigned int length_given ;	/**< @brief Whether length was given.  */
+  unsigned int archive_given ;	/**< @brief Whether archive was given.  */
+  unsigned int index_given ;	/**< @brief Whether index was given.  */
 
   char **inputs ; /**< @brief unamed options (options without names) */
   unsigned inputs_num ; /**< @brief unamed options number */
@@ -28,20 +28,22 @@ const char *aggregator_args_info_usage = "Usage: aggregator [OPTIONS]... [STEP_C
 const char *aggregator_args_info_description = "Dynamic community timeline aggregator tool";
 
 const char *aggregator_args_info_help[] = {
-  "  -h, --help            Print help and exit",
-  "  -V, --version         Print version and exit",
-  "  -p, --persist=DOUBLE  membership persistence threshold (in range 0 to 1, or \n                          no value to use union of all step communities)",
-  "  -l, --length=INT      minimum length (number of time steps) for a dynamic \n                          cluster to be deemed persistent (default=2)",
-  "  -i, --input=FILEPATH  input timeline file",
-  "  -o, --output=PREFIX   prefix for output files",
-  "  -m, --max=INT         maximum time step to process (by default process all \n                          step communities specified)",
+  "  -h, --help                Print help and exit",
+  "  -V, --version             Print version and exit",
+  "  -p, --persist=THRESHOLDS  membership persistence threshold (in range 0 to 1, \n                              or no value to use union of all step \n                              communities), or a comma-separated list of \n                              thresholds to write one file for each and for the \n                              union",
+  "  -l, --length=INT          minimum length (number of time steps) for a dynamic \n                              cluster to be deemed persistent (default=2)",
+  "  -i, --input=FILEPATH      input timeline file",
+  "  -o, --output=PREFIX       prefix for output files",
+  "  -m, --max=INT             maximum time step to process (by default process \n                              all step communities specified)",
+  "  -a, --archive=FILEPATH    step community archive created by the pack tool, \n                              used instead of STEP_COMMUNITIES",
+  "  -x, --index               keep a reverse index of the timelines by step in \n                              the file INPUT.stepindex, reading it if it \n                              matches the timelines and writing it otherwise",
+  "  -j, --threads=INT         number of threads counting the step communities of \n                              timelines  (default=`1')",
     0
 };
 
 typedef enum {ARG_NO
   , ARG_STRING
   , ARG_INT
-  , ARG_DOUBLE
 } cmdline_parser_arg_type;
 
 static
@@ -67,11 +69,15 @@ void clear_given (struct aggregator_args_info *args_info)
   args_info->input_given = 0 ;
   args_info->output_given = 0 ;
   args_info->max_given = 0 ;
+  args_info->archive_given = 0 ;
+  args_info->index_given = 0 ;
+  args_info->threads_given = 0 ;
 }
 
 static
 void clear_args (struct aggregator_args_info *args_info)
 {
+  args_info->persist_arg = NULL;
   args_info->persist_orig = NULL;
   args_info->length_orig = NULL;
   args_info->input_arg = NULL;
@@ -79,6 +85,10 @@ void clear_args (struct aggregator_args_info *args_info)
   args_info->output_arg = NULL;
   args_info->output_orig = NULL;
   args_info->max_orig = NULL;
+  args_info->archive_arg = NULL;
+  args_info->archive_orig = NULL;
+  args_info->threads_arg = 1;
+  args_info->threads_orig = NULL;
   
 }
 
@@ -94,6 +104,9 @@ void init_args_info(struct aggregator_args_info *args_info)
   args_info->input_help = aggregator_args_info_help[4] ;
   args_info->output_help = aggregator_args_info_help[5] ;
   args_info->max_help = aggregator_args_info_help[6] ;
+  args_info->archive_help = aggregator_args_info_help[7] ;
+  args_info->index_help = aggregator_args_info_help[8] ;
+  args_info->threads_help = aggregator_args_info_help[9] ;
   
 }
 
@@ -175,6 +188,7 @@ static void
 cmdline_parser_release (struct aggregator_args_info *args_info)
 {
   unsigned int i;
+  free_string_field (&(args_info->persist_arg));
   free_string_field (&(args_info->persist_orig));
   free_string_field (&(args_info->length_orig));
   free_string_field (&(args_info->input_arg));
@@ -182,6 +196,9 @@ cmdline_parser_release (struct aggregator_args_info *args_info)
   free_string_field (&(args_info->output_arg));
   free_string_field (&(args_info->output_orig));
   free_string_field (&(args_info->max_orig));
+  free_string_field (&(args_info->archive_arg));
+  free_string_field (&(args_info->archive_orig));
+  free_string_field (&(args_info->threads_orig));
   
   
   for (i = 0; i < args_info->inputs_num; ++i)
@@ -230,6 +247,12 @@ cmdline_parser_dump(FILE *outfile, struct aggregator_args_info *args_info)
     write_into_file(outfile, "output", args_info->output_orig, 0);
   if (args_info->max_given)
     write_into_file(outfile, "max", args_info->max_orig, 0);
+  if (args_info->archive_given)
+    write_into_file(outfile, "archive", args_info->archive_orig, 0);
+  if (args_info->index_given)
+    write_into_file(outfile, "index", 0, 0 );
+  if (args_info->threads_given)
+    write_into_file(outfile, "threads", args_info->threads_orig, 0);
   
 
   i = EXIT_SUCCESS;
@@ -394,9 +417,6 @@ int update_arg(void *field, char **orig_field,
   case ARG_INT:
     if (val) *((int *)field) = strtol (val, &stop_char, 0);
     break;
-  case ARG_DOUBLE:
-    if (val) *((double *)field) = strtod (val, &stop_char);
-    break;
   case ARG_STRING:
     if (val) {
       string_field = (char **)field;
@@ -412,7 +432,6 @@ int update_arg(void *field, char **orig_field,
   /* check numeric conversion */
   switch(arg_type) {
   case ARG_INT:
-  case ARG_DOUBLE:
     if (val && !(stop_char && *stop_char == '\0')) {
       fprintf(stderr, "%s: invalid numeric value: %s\n", package_name, val);
       return 1; /* failure */
@@ -485,10 +504,13 @@ cmdline_parser_internal (int argc, char * const *argv, struct aggregator_args_in
         { "input",	1, NULL, 'i' },
         { "output",	1, NULL, 'o' },
         { "max",	1, NULL, 'm' },
+        { "archive",	1, NULL, 'a' },
+        { "index",	0, NULL, 'x' },
+        { "threads",	1, NULL, 'j' },
         { NULL,	0, NULL, 0 }
       };
 
-      c = getopt_long (argc, argv, "hVp:l:i:o:m:", long_options, &option_index);
+      c = getopt_long (argc, argv, "hVp:l:i:o:m:a:xj:", long_options, &option_index);
 
       if (c == -1) break;	/* Exit from `while (1)' loop.  */
 
@@ -504,12 +526,12 @@ cmdline_parser_internal (int argc, char * const *argv, struct aggregator_args_in
           cmdline_parser_free (&local_args_info);
           exit (EXIT_SUCCESS);
 
-        case 'p':	/* membership persistence threshold (in range 0 to 1, or no value to use union of all step communities).  */
+        case 'p':	/* membership persistence threshold (in range 0 to 1, or no value to use union of all step communities), or a comma-separated list of thresholds to write one file for each and for the union.  */
         
         
           if (update_arg( (void *)&(args_info->persist_arg), 
                &(args_info->persist_orig), &(args_info->persist_given),
-              &(local_args_info.persist_given), optarg, 0, 0, ARG_DOUBLE,
+              &(local_args_info.persist_given), optarg, 0, 0, ARG_STRING,
               check_ambiguity, override, 0, 0,
               "persist", 'p',
               additional_error))
@@ -564,6 +586,42 @@ cmdline_parser_internal (int argc, char * const *argv, struct aggregator_args_in
             goto failure;
         
           break;
+        case 'a':	/* step community archive created by the pack tool, used instead of STEP_COMMUNITIES.  */
+        
+        
+          if (update_arg( (void *)&(args_info->archive_arg), 
+               &(args_info->archive_orig), &(args_info->archive_given),
+              &(local_args_info.archive_given), optarg, 0, 0, ARG_STRING,
+              check_ambiguity, override, 0, 0,
+              "archive", 'a',
+              additional_error))
+            goto failure;
+        
+          break;
+        case 'x':	/* keep a reverse index of the timelines by step in the file INPUT.stepindex, reading it if it matches the timelines and writing it otherwise.  */
+        
+        
+          if (update_arg( 0 , 
+               0 , &(args_info->index_given),
+              &(local_args_info.index_given), optarg, 0, 0, ARG_NO,
+              check_ambiguity, override, 0, 0,
+              "index", 'x',
+              additional_error))
+            goto failure;
+        
+          break;
+        case 'j':	/* number of threads counting the step communities of timelines.  */
+        
+        
+          if (update_arg( (void *)&(args_info->threads_arg), 
+               &(args_info->threads_orig), &(args_info->threads_given),
+              &(local_args_info.threads_given), optarg, 0, "1", ARG_INT,
+              check_ambiguity, override, 0, 0,
+              "threads", 'j',
+              additional_error))
+            goto failure;
+        
+          break;
 
         case 0:	/* Long option with no short option */
         case '?':	/* Invalid option.  */
@@ -34,9 +34,9 @@ struct aggregator_args_info
 {
   const char *help_help; /**< @brief Print help and exit help description.  */
   const char *version_help; /**< @brief Print version and exit help description.  */
-  double persist_arg;	/**< @brief membership persistence threshold (in range 0 to 1, or no value to use union of all step communities).  */
-  char * persist_orig;	/**< @brief membership persistence threshold (in range 0 to 1, or no value to use union of all step communities) original value given at command line.  */
-  const char *persist_help; /**< @brief membership persistence threshold (in range 0 to 1, or no value to use union of all step communities) help description.  */
+  char * persist_arg;	/**< @brief membership persistence threshold (in range 0 to 1, or no value to use union of all step communities), or a comma-separated list of thresholds to write one file for each and for the union.  */
+  char * persist_orig;	/**< @brief membership persistence threshold (in range 0 to 1, or no value to use union of all step communities), or a comma-separated list of thresholds to write one file for each and for the union original value given at command line.  */
+  const char *persist_help; /**< @brief membership persistence threshold (in range 0 to 1, or no value to use union of all step communities), or a comma-separated list of thresholds to write one file for each and for the union help description.  */
   int length_arg;	/**< @brief minimum length (number of time steps) for a dynamic cluster to be deemed persistent (default=2).  */
   char * length_orig;	/**< @brief minimum length (number of time steps) for a dynamic cluster to be deemed persistent (default=2) original value given at command line.  */
   const char *length_help; /**< @brief minimum length (number of time steps) for a dynamic cluster to be deemed persistent (default=2) help description.  */
@@ -49,6 +49,13 @@ struct aggregator_args_info
   int max_arg;	/**< @brief maximum time step to process (by default process all step communities specified).  */
   char * max_orig;	/**< @brief maximum time step to process (by default process all step communities specified) original value given at command line.  */
   const char *max_help; /**< @brief maximum time step to process (by default process all step communities specified) help description.  */
+  char * archive_arg;	/**< @brief step community archive created by the pack tool, used instead of STEP_COMMUNITIES.  */
+  char * archive_orig;	/**< @brief step community archive created by the pack tool, used instead of STEP_COMMUNITIES original value given at command line.  */
+  const char *archive_help; /**< @brief step community archive created by the pack tool, used instead of STEP_COMMUNITIES help description.  */
+  const char *index_help; /**< @brief keep a reverse index of the timelines by step in the file INPUT.stepindex, reading it if it matches the timelines and writing it otherwise help description.  */
+  int threads_arg;	/**< @brief number of threads counting the step communities of timelines (default='1').  */
+  char * threads_orig;	/**< @brief number of threads counting the step communities of timelines original value given at command line.  */
+  const char *threads_help; /**< @brief number of threads counting the step communities of timelines help description.  */
   
   unsigned int help_given ;	/**< @brief Whether help was given.  */
   unsigned int version_given ;	/**< @brief Whether version was given.  */
@@ -57,6 +64,9 @@ struct aggregator_args_info
   unsigned int input_given ;	/**< @brief Whether input was given.  */
   unsigned int output_given ;	/**< @brief Whether output was given.  */
   unsigned int max_given ;	/**< @brief Whether max was given.  */
+  unsigned int archive_given ;	/**< @brief Whether archive was given.  */
+  unsigned int index_given ;	/**< @brief Whether index was given.  */
+  unsigned int threads_given ;	/**< @brief Whether threads was given.  */
 
   char **inputs ; /**< @brief unamed options (options without names) */
   unsigned inputs_num ; /**< @brief unamed options number */
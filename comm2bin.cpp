@@ -0,0 +1,55 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// ------------------------------------------------------------------------------------------
+// Step community binary format converter
+// ------------------------------------------------------------------------------------------
+
+#include "settings.h"
+#include "common/standard.h"
+#include "common/clustering.h"
+
+int main(int argc, char *argv[])
+{
+	if( argc != 3 )
+	{
+		cerr << "Error: Invalid number of arguments." << endl;
+		cerr << "Usage: " << argv[0] << " step_communities output_file" << endl;
+		return -1;
+	}
+	string in_fname(argv[1]);
+	string out_fname(argv[2]);
+
+	cout << "* Loading step communities from " << in_fname << " ..." << endl;
+	Clustering clustering;
+	if( !read_clustering_mmap( in_fname, DEFAULT_DELIM, clustering ) )
+	{
+		cerr << "Error: Failed to read communities from file " << in_fname << endl;
+		return -1;
+	}
+	cout << "Found " << clustering.size() << " non-empty step communities" << endl;
+	
+	cout << "Writing binary step communities to " << out_fname << endl;
+	if( !write_clustering_binary( out_fname, clustering ) )
+	{
+		cerr << "Error: Cannot write file " << out_fname << endl;
+		return -1;
+	}
+	
+	cout << "Done." << endl;
+	return 0;
+}
@@ -14,9 +14,151 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <ctype.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits>
 #include "settings.h"
 #include "standard.h"
 #include "clustering.h"
+#include "util.h"
+
+// ----------------------------------------------------------------------------
+// NODE DICTIONARY
+// ----------------------------------------------------------------------------
+
+NodeDictionary::NodeDictionary() : m_slots( 1024, 0 )
+{
+	pthread_mutex_init( &m_lock, NULL );
+}
+
+NodeDictionary::~NodeDictionary()
+{
+	pthread_mutex_destroy( &m_lock );
+}
+
+static inline size_t hash_node( const NODE node )
+{
+	unsigned long long h = (unsigned long long)node;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return (size_t)h;
+}
+
+/**
+ * Looks up the dense identifiers of a batch of nodes, assigning the next 
+ * free identifier to any node not seen before. Safe to call concurrently.
+ *
+ * @param nodes   the node identifiers to look up
+ * @param count   number of nodes
+ * @param ids     resulting dense identifiers
+ */
+void NodeDictionary::intern( const NODE* nodes, const size_t count, NODE_ID* ids )
+{
+	pthread_mutex_lock( &m_lock );
+	for( size_t i = 0; i < count; i++ )
+	{
+		size_t mask = m_slots.size() - 1;
+		size_t pos = hash_node( nodes[i] ) & mask;
+		while( m_slots[pos] != 0 && m_external[m_slots[pos]-1] != nodes[i] )
+		{
+			pos = ( pos + 1 ) & mask;
+		}
+		if( m_slots[pos] == 0 )
+		{
+			m_external.push_back( nodes[i] );
+			m_slots[pos] = (NODE_ID)m_external.size();
+			// keep the table at most half full
+			if( 2*m_external.size() > m_slots.size() )
+			{
+				grow();
+			}
+			ids[i] = (NODE_ID)( m_external.size() - 1 );
+		}
+		else
+		{
+			ids[i] = m_slots[pos] - 1;
+		}
+	}
+	pthread_mutex_unlock( &m_lock );
+}
+
+void NodeDictionary::grow()
+{
+	vector<NODE_ID> slots( 2*m_slots.size(), 0 );
+	size_t mask = slots.size() - 1;
+	for( size_t id = 0; id < m_external.size(); id++ )
+	{
+		size_t pos = hash_node( m_external[id] ) & mask;
+		while( slots[pos] != 0 )
+		{
+			pos = ( pos + 1 ) & mask;
+		}
+		slots[pos] = (NODE_ID)( id + 1 );
+	}
+	m_slots.swap( slots );
+}
+
+/**
+ * Translates a batch of dense identifiers back to the original node identifiers.
+ */
+void NodeDictionary::external( const NODE_ID* ids, const size_t count, NODE* nodes ) const
+{
+	pthread_mutex_lock( &m_lock );
+	for( size_t i = 0; i < count; i++ )
+	{
+		nodes[i] = m_external[ids[i]];
+	}
+	pthread_mutex_unlock( &m_lock );
+}
+
+/**
+ * Returns the number of distinct nodes seen so far, which is also one more 
+ * than the largest dense identifier assigned.
+ */
+NODE_ID NodeDictionary::size() const
+{
+	pthread_mutex_lock( &m_lock );
+	NODE_ID count = (NODE_ID)m_external.size();
+	pthread_mutex_unlock( &m_lock );
+	return count;
+}
+
+/**
+ * Returns the dictionary shared by all clusterings read by this process.
+ */
+NodeDictionary &node_dictionary()
+{
+	static NodeDictionary dictionary;
+	return dictionary;
+}
+
+/**
+ * Interns a batch of nodes as a new cluster at the end of the clustering.
+ */
+static void add_cluster( const vector<NODE> &members, vector<NODE_ID> &ids, Clustering &clustering )
+{
+	ids.resize( members.size() );
+	node_dictionary().intern( &members[0], members.size(), &ids[0] );
+	sort( ids.begin(), ids.end() );
+	clustering.push_back( Cluster() );
+	clustering.back().insert( ids.begin(), unique( ids.begin(), ids.end() ) );
+}
+
+/**
+ * Gets the original node identifiers of a cluster, in ascending order.
+ */
+static void external_nodes( const Cluster &cluster, vector<NODE_ID> &ids, vector<NODE> &nodes )
+{
+	ids.assign( cluster.begin(), cluster.end() );
+	nodes.resize( ids.size() );
+	if( !ids.empty() )
+	{
+		node_dictionary().external( &ids[0], ids.size(), &nodes[0] );
+	}
+	sort( nodes.begin(), nodes.end() );
+}
 
 // ----------------------------------------------------------------------------
 // GENERAL CLUSTERING STATS & OPERATIONS
@@ -30,18 +172,16 @@
  *
  * @return number of assigned nodes.
  */
-long assigned( const Clustering &clustering, set<NODE> &nodes )
+long assigned( const Clustering &clustering, Cluster &nodes )
 {
-	nodes.clear();
+	vector<NODE_ID> all;
 	Clustering::const_iterator cit;
 	for( cit = clustering.begin() ; cit != clustering.end(); cit++ )
 	{
-		Cluster::const_iterator it;
-		for( it = (*cit).begin() ; it != (*cit).end(); it++ )
-		{
-			nodes.insert( *it );
-		}
+		all.insert( all.end(), (*cit).begin(), (*cit).end() );
 	}
+	nodes.clear();
+	nodes.insert( all.begin(), all.end() );
 	return (long)nodes.size();
 }
 
@@ -54,8 +194,22 @@ long assigned( const Clustering &clustering, set<NODE> &nodes )
  */
 long assigned_count( const Clustering &clustering )
 {
-	set<NODE> nodes;
-	return assigned(clustering,nodes);
+	long count = 0;
+	vector<bool> seen( node_dictionary().size(), false );
+	Clustering::const_iterator cit;
+	for( cit = clustering.begin() ; cit != clustering.end(); cit++ )
+	{
+		Cluster::const_iterator it;
+		for( it = (*cit).begin() ; it != (*cit).end(); it++ )
+		{
+			if( !seen[*it] )
+			{
+				seen[*it] = true;
+				count++;
+			}
+		}
+	}
+	return count;
 }
 
 /**
@@ -68,20 +222,20 @@ long assigned_count( const Clustering &clustering )
 long overlapping_count( const Clustering &clustering )
 {
 	long count = 0;
-	set<NODE> nodes;
+	vector<bool> seen( node_dictionary().size(), false );
 	Clustering::const_iterator cit;
 	for( cit = clustering.begin() ; cit != clustering.end(); cit++ )
 	{
 		Cluster::const_iterator it;
 		for( it = (*cit).begin() ; it != (*cit).end(); it++ )
 		{
-			if( nodes.count( *it ) )
+			if( seen[*it] )
 			{
 				count++;
 			}
 			else
 			{
-				nodes.insert( *it );
+				seen[*it] = true;
 			}
 		}
 	}
@@ -155,8 +309,26 @@ int remove_small_clusters( Clustering &clustering, const int min_size )
 int remove_duplicate_clusters( Clustering &clustering )
 {
 	int previous = (int)clustering.size();
-	sort(clustering.begin(), clustering.end());
-   clustering.erase(unique(clustering.begin(), clustering.end()), clustering.end());
+	// order by the original node identifiers, so output does not depend on the order nodes were read
+	vector< pair< vector<NODE>, int > > keyed( clustering.size() );
+	vector<NODE_ID> ids;
+	for( int i = 0; i < previous; i++ )
+	{
+		external_nodes( clustering[i], ids, keyed[i].first );
+		keyed[i].second = i;
+	}
+	sort( keyed.begin(), keyed.end() );
+	Clustering unique_clustering;
+	for( int i = 0; i < previous; i++ )
+	{
+		if( i > 0 && keyed[i].first == keyed[i-1].first )
+		{
+			continue;
+		}
+		unique_clustering.push_back( Cluster() );
+		unique_clustering.back().swap( clustering[keyed[i].second] );
+	}
+	clustering.swap( unique_clustering );
 	return previous - (int)clustering.size();
 }
 
@@ -181,6 +353,149 @@ long max_cluster_size( const Clustering &clustering )
 	return max_size;
 }
 
+// ----------------------------------------------------------------------------
+// BINARY CLUSTERING FORMAT
+// ----------------------------------------------------------------------------
+//
+// A binary step clustering stores all clusters in compressed sparse row form,
+// using the native byte order of the machine that wrote it:
+//
+//   char      magic[8]                      BINARY_CLUSTERING_MAGIC
+//   uint64_t  num_clusters
+//   uint64_t  num_members
+//   uint64_t  offsets[num_clusters+1]       start of each cluster in nodes[]
+//   int64_t   nodes[num_members]            sorted node ids of each cluster
+// ----------------------------------------------------------------------------
+
+static const char BINARY_CLUSTERING_MAGIC[8] = { 'D', 'C', 'S', 'T', 'E', 'P', '0', '1' };
+
+/**
+ * Checks whether a block of memory starts with the binary clustering header.
+ */
+bool is_binary_clustering( const char* data, const size_t size )
+{
+	return size >= sizeof(BINARY_CLUSTERING_MAGIC) && memcmp( data, BINARY_CLUSTERING_MAGIC, sizeof(BINARY_CLUSTERING_MAGIC) ) == 0;
+}
+
+/**
+ * Checks whether a block of memory starts with the header of another binary file written by 
+ * these tools, such as a step archive, binary timeline or step index. Each header is "DC", 
+ * a four letter tag and a two digit version, which cannot begin a text clustering.
+ */
+static bool is_other_binary( const char* data, const size_t size )
+{
+	if( size < sizeof(BINARY_CLUSTERING_MAGIC) || is_binary_clustering( data, size ) )
+	{
+		return false;
+	}
+	return data[0] == 'D' && data[1] == 'C' && isdigit( (unsigned char)data[6] ) && isdigit( (unsigned char)data[7] );
+}
+
+/**
+ * Reads a binary clustering from a block of memory, such as a mapped file.
+ *
+ * @param data         start of the binary clustering
+ * @param size         number of bytes available
+ * @param clustering   the clustering to store the input.
+ *
+ * @return false if the block is truncated or inconsistent.
+ */
+bool read_clustering_binary( const char* data, const size_t size, Clustering &clustering )
+{
+	clustering.clear();
+	const size_t header_size = sizeof(BINARY_CLUSTERING_MAGIC) + 2*sizeof(uint64_t);
+	if( !is_binary_clustering( data, size ) || size < header_size )
+	{
+		return false;
+	}
+	uint64_t num_clusters, num_members;
+	memcpy( &num_clusters, data + sizeof(BINARY_CLUSTERING_MAGIC), sizeof(uint64_t) );
+	memcpy( &num_members, data + sizeof(BINARY_CLUSTERING_MAGIC) + sizeof(uint64_t), sizeof(uint64_t) );
+	if( num_clusters >= ( size - header_size ) / sizeof(uint64_t) 
+		|| num_members > ( size - header_size - (num_clusters+1)*sizeof(uint64_t) ) / sizeof(int64_t) )
+	{
+		return false;
+	}
+	const uint64_t* offsets = (const uint64_t*)( data + header_size );
+	const int64_t* nodes = (const int64_t*)( offsets + num_clusters + 1 );
+	if( offsets[0] != 0 || offsets[num_clusters] != num_members )
+	{
+		return false;
+	}
+	clustering.reserve( (size_t)num_clusters );
+	vector<NODE> members;
+	vector<NODE_ID> ids;
+	for( uint64_t i = 0; i < num_clusters; i++ )
+	{
+		if( offsets[i+1] < offsets[i] || offsets[i+1] > num_members )
+		{
+			clustering.clear();
+			return false;
+		}
+		if( offsets[i+1] > offsets[i] )
+		{
+			members.assign( nodes + offsets[i], nodes + offsets[i+1] );
+			add_cluster( members, ids, clustering );
+		}
+	}
+	return true;
+}
+
+/**
+ * Write a clustering to the specified file in the binary format.
+ *
+ * @param fname        output file path
+ * @param clustering   the clustering to write.
+ */
+bool write_clustering_binary( const string fname, const Clustering &clustering )
+{
+	ofstream fout( fname.c_str(), ios::out | ios::binary );
+	if(!fout) 
+	{  
+		return false; 
+	}
+	write_clustering_binary( fout, clustering );
+	fout.close();
+	return !fout.fail();
+}
+
+/**
+ * Write a clustering in the binary format to an open stream. The number of 
+ * bytes written is always a multiple of 8.
+ *
+ * @param fout         output stream, opened in binary mode
+ * @param clustering   the clustering to write.
+ */
+bool write_clustering_binary( ostream &fout, const Clustering &clustering )
+{
+	vector<uint64_t> offsets;
+	offsets.push_back(0);
+	Clustering::const_iterator cit;
+	for( cit = clustering.begin() ; cit != clustering.end(); cit++ )
+	{
+		offsets.push_back( offsets.back() + (*cit).size() );
+	}
+	uint64_t num_clusters = (uint64_t)clustering.size();
+	uint64_t num_members = offsets.back();
+	fout.write( BINARY_CLUSTERING_MAGIC, sizeof(BINARY_CLUSTERING_MAGIC) );
+	fout.write( (const char*)&num_clusters, sizeof(uint64_t) );
+	fout.write( (const char*)&num_members, sizeof(uint64_t) );
+	fout.write( (const char*)&offsets[0], offsets.size()*sizeof(uint64_t) );
+	vector<NODE_ID> ids;
+	vector<NODE> members;
+	vector<int64_t> nodes;
+	for( cit = clustering.begin() ; cit != clustering.end(); cit++ )
+	{
+		external_nodes( *cit, ids, members );
+		nodes.assign( members.begin(), members.end() );
+		if( !nodes.empty() )
+		{
+			fout.write( (const char*)&nodes[0], nodes.size()*sizeof(int64_t) );
+		}
+	}
+	return !fout.fail();
+}
+
 // ----------------------------------------------------------------------------
 // CLUSTERING INPUT/OUTPUT
 // ----------------------------------------------------------------------------
@@ -201,6 +516,8 @@ bool write_clustering( const string fname, const char sep, const Clustering &clu
    }
 	Clustering::const_iterator cit = clustering.begin();
 	int cluster_index = 0;
+	vector<NODE_ID> ids;
+	vector<NODE> nodes;
 	for( cit = clustering.begin() ; cit != clustering.end(); cit++,cluster_index++ )
 	{
 		if( (*cit).empty() )
@@ -208,9 +525,10 @@ bool write_clustering( const string fname, const char sep, const Clustering &clu
 			cerr << "Warning: cluster " << (cluster_index+1) << "is empty. Ignoring." << endl;
 			continue;
 		}
-		Cluster::iterator xit;
+		external_nodes( *cit, ids, nodes );
+		vector<NODE>::const_iterator xit;
 		int pos = 0;
-		for( xit = (*cit).begin() ; xit != (*cit).end(); xit++ )
+		for( xit = nodes.begin() ; xit != nodes.end(); xit++ )
 		{
 			if( pos > 0 )
 			{
@@ -240,12 +558,27 @@ bool read_clustering( const string fname, const char sep, Clustering &clustering
 	{  
     	return false; 
    } 
+	char magic[sizeof(BINARY_CLUSTERING_MAGIC)];
+	if( fin.read( magic, sizeof(magic) ) && is_binary_clustering( magic, sizeof(magic) ) )
+	{
+		fin.close();
+		return read_clustering_mmap( fname, sep, clustering );
+	}
+	if( fin && is_other_binary( magic, sizeof(magic) ) )
+	{
+		cerr << "Error: " << fname << " is not a communities file" << endl;
+		return false;
+	}
+	fin.clear();
+	fin.seekg( 0, ios::beg );
 	string line;
 	long num = 0;
+	vector<NODE> cluster;
+	vector<NODE_ID> ids;
 	while(getline(fin, line, '\n') ) 
 	{
 		num += 1;
-		Cluster cluster;
+		cluster.clear();
 	   stringstream ss(line);
 		string temp;
 	   while (getline(ss, temp, sep)) 
@@ -260,24 +593,143 @@ bool read_clustering( const string fname, const char sep, Clustering &clustering
 			}
 			else
 			{
-				cluster.insert(node_index);
+				cluster.push_back(node_index);
 			}
 	   }
 		if(!cluster.empty())
 		{
-			clustering.push_back(cluster);
+			add_cluster( cluster, ids, clustering );
 		}
 	}
 	fin.close();
 	return true;
 }
 
+/**
+ * Parses a single node index token, following the same rules as extracting
+ * a NODE from a stream: leading whitespace is skipped, an optional sign and
+ * at least one digit are required, and any trailing characters are ignored.
+ *
+ * @param first        start of the token
+ * @param last         end of the token (exclusive)
+ * @param node_index   the parsed value
+ *
+ * @return false if the token is not a valid node index.
+ */
+static inline bool parse_node( const char* first, const char* last, NODE &node_index )
+{
+	while( first != last && isspace( (unsigned char)*first ) )
+	{
+		first++;
+	}
+	bool negative = false;
+	if( first != last && ( *first == '-' || *first == '+' ) )
+	{
+		negative = ( *first == '-' );
+		first++;
+	}
+	if( first == last || *first < '0' || *first > '9' )
+	{
+		return false;
+	}
+	const unsigned long long limit = negative ? (unsigned long long)numeric_limits<NODE>::max() + 1 : (unsigned long long)numeric_limits<NODE>::max();
+	unsigned long long value = 0;
+	for( ; first != last && *first >= '0' && *first <= '9'; first++ )
+	{
+		unsigned digit = (unsigned)( *first - '0' );
+		if( value > ( limit - digit ) / 10 )
+		{
+			return false;
+		}
+		value = value * 10 + digit;
+	}
+	node_index = negative ? (NODE)( 0 - value ) : (NODE)value;
+	return true;
+}
+
+/**
+ * Reads a clustering from the specified file, one line per cluster. The file
+ * is memory-mapped and tokenized in place, rather than copied line-by-line
+ * through streams. Produces the same clustering and warnings as read_clustering().
+ * Files in the binary clustering format are detected by their header and 
+ * loaded directly from the mapping.
+ *
+ * @param fname        input file path
+ * @param sep          separator character to use
+ * @param clustering   the clustering to store the input.
+ */
+bool read_clustering_mmap( const string fname, const char sep, Clustering &clustering )
+{
+	clustering.clear();
+	MappedFile fin;
+	if( !fin.open( fname ) )
+	{
+		return false;
+	}
+	if( is_binary_clustering( fin.data(), fin.size() ) )
+	{
+		if( !read_clustering_binary( fin.data(), fin.size(), clustering ) )
+		{
+			cerr << "Error: Corrupt binary communities file " << fname << endl;
+			return false;
+		}
+		return true;
+	}
+	if( is_other_binary( fin.data(), fin.size() ) )
+	{
+		cerr << "Error: " << fname << " is not a communities file" << endl;
+		return false;
+	}
+	const char* pos = fin.data();
+	const char* end = pos + fin.size();
+	vector<NODE> members;
+	vector<NODE_ID> ids;
+	long num = 0;
+	while( pos < end )
+	{
+		num += 1;
+		const char* eol = (const char*)memchr( pos, '\n', end - pos );
+		if( eol == NULL )
+		{
+			eol = end;
+		}
+		members.clear();
+		while( pos < eol )
+		{
+			const char* token_end = (const char*)memchr( pos, sep, eol - pos );
+			if( token_end == NULL )
+			{
+				token_end = eol;
+			}
+			NODE node_index;
+			if( parse_node( pos, token_end, node_index ) )
+			{
+				members.push_back( node_index );
+			}
+			else
+			{
+				cerr << "Warning: Skipping invalid node index '" << string( pos, token_end ) << "' on line " << num << endl;
+			}
+			pos = token_end + 1;
+		}
+		pos = eol + 1;
+		if( !members.empty() )
+		{
+			add_cluster( members, ids, clustering );
+		}
+	}
+	return true;
+}
+
 /**
  * Simply print the content of a cluster to stdout.
  */
 void print_cluster( Cluster &cluster )
 {
-	copy( cluster.begin(), cluster.end(), ostream_iterator<NODE>( cout, " " ) );
+	vector<NODE_ID> ids;
+	vector<NODE> nodes;
+	external_nodes( cluster, ids, nodes );
+	copy( nodes.begin(), nodes.end(), ostream_iterator<NODE>( cout, " " ) );
 	cout << endl;
 }
 
@@ -18,12 +18,47 @@
 #ifndef CLUSTER_H
 #define CLUSTER_H
 
-/** represents an individual cluster */
-typedef set<NODE> Cluster;
+#include <pthread.h>
+#include "flatset.h"
+
+/** represents an individual cluster, as a sorted array of dense node identifiers */
+typedef FlatSet<NODE_ID> Cluster;
 /** represents a vector of zero or more clusters */
 typedef vector<Cluster> Clustering;
 
-long assigned( const Clustering &clustering, set<NODE> &nodes );
+// ------------------------------------------------------------------------------------------
+// Class: NodeDictionary
+// ------------------------------------------------------------------------------------------
+
+/** maps node identifiers to dense identifiers, numbered from 0 in order of first appearance */
+class NodeDictionary
+{
+public:
+	NodeDictionary();
+	~NodeDictionary();
+
+	void intern( const NODE* nodes, const size_t count, NODE_ID* ids );
+	void external( const NODE_ID* ids, const size_t count, NODE* nodes ) const;
+	NODE_ID size() const;
+
+private:
+	NodeDictionary( const NodeDictionary& );
+	NodeDictionary& operator=( const NodeDictionary& );
+
+	void grow();
+
+	/** open addressing hash table of dense identifiers plus one, with 0 marking an empty slot */
+	vector<NODE_ID> m_slots;
+	/** original node identifier for each dense identifier */
+	vector<NODE> m_external;
+	mutable pthread_mutex_t m_lock;
+};
+
+NodeDictionary &node_dictionary();
+
+// ------------------------------------------------------------------------------------------
+
+long assigned( const Clustering &clustering, Cluster &nodes );
 long assigned_count( const Clustering &clustering );
 long overlapping_count( const Clustering &clustering );
 long max_cluster_size( const Clustering &clustering );
@@ -33,7 +68,12 @@ int remove_small_clusters( Clustering &clustering, const int min_size );
 int remove_duplicate_clusters( Clustering &clustering );
 
 bool read_clustering( const string fname, const char sep, Clustering &clustering);
+bool read_clustering_mmap( const string fname, const char sep, Clustering &clustering );
 bool write_clustering( const string fname, const char sep, const Clustering &clustering );
+bool is_binary_clustering( const char* data, const size_t size );
+bool read_clustering_binary( const char* data, const size_t size, Clustering &clustering );
+bool write_clustering_binary( const string fname, const Clustering &clustering );
+bool write_clustering_binary( ostream &fout, const Clustering &clustering );
 void print_cluster( Cluster &cluster );
 void print_cluster_sizes( const Clustering &clustering );
 
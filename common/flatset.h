@@ -0,0 +1,159 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLATSET_H
+#define FLATSET_H
+
+#include "standard.h"
+
+// ------------------------------------------------------------------------------------------
+// Class: FlatSet
+// ------------------------------------------------------------------------------------------
+
+/**
+ * A set stored as a sorted vector of unique values. Supports the subset of
+ * the std::set interface used for clusters, with contiguous storage and no
+ * per-element allocation. Iterators are read-only, so the order cannot be broken.
+ * Inserting a single value is linear unless it belongs at the end, so sets
+ * should be built from ranges or in ascending order.
+ */
+template <class T>
+class FlatSet
+{
+public:
+	typedef T value_type;
+	typedef T key_type;
+	typedef const T& reference;
+	typedef const T& const_reference;
+	typedef typename vector<T>::const_iterator iterator;
+	typedef typename vector<T>::const_iterator const_iterator;
+	typedef typename vector<T>::size_type size_type;
+
+	FlatSet() {}
+
+	template <class InputIterator>
+	FlatSet( InputIterator first, InputIterator last )
+	{
+		insert( first, last );
+	}
+
+	const_iterator begin() const { return m_values.begin(); }
+	const_iterator end() const { return m_values.end(); }
+	size_type size() const { return m_values.size(); }
+	bool empty() const { return m_values.empty(); }
+	void clear() { m_values.clear(); }
+	void reserve( const size_type count ) { m_values.reserve( count ); }
+	void swap( FlatSet &other ) { m_values.swap( other.m_values ); }
+	/** the values in ascending order, as a contiguous array */
+	const T* data() const { return m_values.empty() ? NULL : &m_values[0]; }
+
+	const_iterator lower_bound( const T &value ) const
+	{
+		return std::lower_bound( m_values.begin(), m_values.end(), value );
+	}
+
+	const_iterator find( const T &value ) const
+	{
+		const_iterator it = lower_bound( value );
+		return ( it != m_values.end() && !( value < *it ) ) ? it : m_values.end();
+	}
+
+	size_type count( const T &value ) const
+	{
+		return find( value ) != m_values.end() ? 1 : 0;
+	}
+
+	pair<const_iterator,bool> insert( const T &value )
+	{
+		if( m_values.empty() || m_values.back() < value )
+		{
+			m_values.push_back( value );
+			return make_pair( m_values.end() - 1, true );
+		}
+		typename vector<T>::iterator it = std::lower_bound( m_values.begin(), m_values.end(), value );
+		if( !( value < *it ) )
+		{
+			return make_pair( const_iterator(it), false );
+		}
+		it = m_values.insert( it, value );
+		return make_pair( const_iterator(it), true );
+	}
+
+	/** the position is ignored; provided so that insert_iterator can be used */
+	const_iterator insert( const_iterator, const T &value )
+	{
+		return insert( value ).first;
+	}
+
+	template <class InputIterator>
+	void insert( InputIterator first, InputIterator last )
+	{
+		size_type previous = m_values.size();
+		m_values.insert( m_values.end(), first, last );
+		typename vector<T>::iterator middle = m_values.begin() + previous;
+		if( !is_strictly_sorted( middle ) )
+		{
+			sort( middle, m_values.end() );
+		}
+		if( previous > 0 && middle != m_values.end() && !( *(middle-1) < *middle ) )
+		{
+			inplace_merge( m_values.begin(), middle, m_values.end() );
+		}
+		else if( is_strictly_sorted( m_values.begin() ) )
+		{
+			return;
+		}
+		m_values.erase( unique( m_values.begin(), m_values.end() ), m_values.end() );
+	}
+
+	size_type erase( const T &value )
+	{
+		typename vector<T>::iterator it = std::lower_bound( m_values.begin(), m_values.end(), value );
+		if( it == m_values.end() || value < *it )
+		{
+			return 0;
+		}
+		m_values.erase( it );
+		return 1;
+	}
+
+	bool operator==( const FlatSet &other ) const { return m_values == other.m_values; }
+	bool operator!=( const FlatSet &other ) const { return m_values != other.m_values; }
+	bool operator<( const FlatSet &other ) const { return m_values < other.m_values; }
+
+private:
+	bool is_strictly_sorted( typename vector<T>::iterator first ) const
+	{
+		typename vector<T>::const_iterator it = first;
+		if( it == m_values.end() )
+		{
+			return true;
+		}
+		for( typename vector<T>::const_iterator next = it + 1; next != m_values.end(); it++, next++ )
+		{
+			if( !( *it < *next ) )
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	vector<T> m_values;
+};
+
+#endif // FLATSET_H
@@ -0,0 +1,271 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "settings.h"
+#include "standard.h"
+#include "intersect.h"
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define INTERSECT_X86
+#include <immintrin.h>
+#endif
+
+/** use galloping search once one set is this many times larger than the other */
+#define GALLOP_RATIO 32
+
+// ----------------------------------------------------------------------------
+// KERNELS
+// ----------------------------------------------------------------------------
+
+/*
+ * All kernels count the values common to two strictly increasing arrays. The
+ * vector kernels compare a block of each array against every rotation of the 
+ * other, then advance whichever block ends with the smaller value. Because 
+ * values are unique, each common value is counted once, in the only pair of 
+ * blocks containing it. The remainder is finished by the scalar merge.
+ */
+
+static size_t intersection_count_scalar( const NODE_ID* a, size_t i, const size_t size_a, const NODE_ID* b, size_t j, const size_t size_b )
+{
+	size_t count = 0;
+	while( i < size_a && j < size_b )
+	{
+		if( a[i] < b[j] )
+		{
+			i++;
+		}
+		else if( b[j] < a[i] )
+		{
+			j++;
+		}
+		else
+		{
+			count++;
+			i++;
+			j++;
+		}
+	}
+	return count;
+}
+
+static size_t intersection_count_merge( const NODE_ID* a, const size_t size_a, const NODE_ID* b, const size_t size_b )
+{
+	return intersection_count_scalar( a, 0, size_a, b, 0, size_b );
+}
+
+#ifdef INTERSECT_X86
+
+__attribute__((target("sse4.2,popcnt")))
+static size_t intersection_count_sse4( const NODE_ID* a, const size_t size_a, const NODE_ID* b, const size_t size_b )
+{
+	size_t i = 0, j = 0, count = 0;
+	const size_t end_a = size_a & ~(size_t)3, end_b = size_b & ~(size_t)3;
+	while( i < end_a && j < end_b )
+	{
+		__m128i va = _mm_loadu_si128( (const __m128i*)( a + i ) );
+		__m128i vb = _mm_loadu_si128( (const __m128i*)( b + j ) );
+		__m128i eq = _mm_cmpeq_epi32( va, vb );
+		eq = _mm_or_si128( eq, _mm_cmpeq_epi32( va, _mm_shuffle_epi32( vb, _MM_SHUFFLE(0,3,2,1) ) ) );
+		eq = _mm_or_si128( eq, _mm_cmpeq_epi32( va, _mm_shuffle_epi32( vb, _MM_SHUFFLE(1,0,3,2) ) ) );
+		eq = _mm_or_si128( eq, _mm_cmpeq_epi32( va, _mm_shuffle_epi32( vb, _MM_SHUFFLE(2,1,0,3) ) ) );
+		count += _mm_popcnt_u32( _mm_movemask_ps( _mm_castsi128_ps( eq ) ) );
+		const NODE_ID last_a = a[i+3], last_b = b[j+3];
+		if( last_a <= last_b )
+		{
+			i += 4;
+		}
+		if( last_b <= last_a )
+		{
+			j += 4;
+		}
+	}
+	return count + intersection_count_scalar( a, i, size_a, b, j, size_b );
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t intersection_count_avx2( const NODE_ID* a, const size_t size_a, const NODE_ID* b, const size_t size_b )
+{
+	size_t i = 0, j = 0, count = 0;
+	const size_t end_a = size_a & ~(size_t)7, end_b = size_b & ~(size_t)7;
+	const __m256i rotate = _mm256_setr_epi32( 1, 2, 3, 4, 5, 6, 7, 0 );
+	while( i < end_a && j < end_b )
+	{
+		__m256i va = _mm256_loadu_si256( (const __m256i*)( a + i ) );
+		__m256i vb = _mm256_loadu_si256( (const __m256i*)( b + j ) );
+		__m256i eq = _mm256_cmpeq_epi32( va, vb );
+		for( int r = 1; r < 8; r++ )
+		{
+			vb = _mm256_permutevar8x32_epi32( vb, rotate );
+			eq = _mm256_or_si256( eq, _mm256_cmpeq_epi32( va, vb ) );
+		}
+		count += _mm_popcnt_u32( _mm256_movemask_ps( _mm256_castsi256_ps( eq ) ) );
+		const NODE_ID last_a = a[i+7], last_b = b[j+7];
+		if( last_a <= last_b )
+		{
+			i += 8;
+		}
+		if( last_b <= last_a )
+		{
+			j += 8;
+		}
+	}
+	return count + intersection_count_scalar( a, i, size_a, b, j, size_b );
+}
+
+#endif // INTERSECT_X86
+
+/**
+ * Counts by looking up each value of the small set in the large one, with an
+ * exponential search starting from the position of the previous value.
+ */
+static size_t intersection_count_gallop( const NODE_ID* small, const size_t size_small, const NODE_ID* large, const size_t size_large )
+{
+	size_t count = 0, low = 0;
+	for( size_t i = 0; i < size_small && low < size_large; i++ )
+	{
+		const NODE_ID value = small[i];
+		size_t step = 1, high = low;
+		while( high < size_large && large[high] < value )
+		{
+			low = high + 1;
+			high += step;
+			step <<= 1;
+		}
+		if( high > size_large )
+		{
+			high = size_large;
+		}
+		low = lower_bound( large + low, large + high, value ) - large;
+		if( low < size_large && large[low] == value )
+		{
+			count++;
+			low++;
+		}
+	}
+	return count;
+}
+
+// ----------------------------------------------------------------------------
+// DISPATCH
+// ----------------------------------------------------------------------------
+
+typedef size_t (*IntersectionKernel)( const NODE_ID*, const size_t, const NODE_ID*, const size_t );
+
+struct KernelChoice
+{
+	IntersectionKernel kernel;
+	const char* name;
+};
+
+static KernelChoice choose_kernel()
+{
+	KernelChoice choice = { intersection_count_merge, "scalar" };
+#ifdef INTERSECT_X86
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "popcnt" ) )
+	{
+		choice.kernel = intersection_count_avx2;
+		choice.name = "avx2";
+	}
+	else if( __builtin_cpu_supports( "sse4.2" ) && __builtin_cpu_supports( "popcnt" ) )
+	{
+		choice.kernel = intersection_count_sse4;
+		choice.name = "sse4";
+	}
+#endif
+	return choice;
+}
+
+/** chosen once, when the program starts */
+static const KernelChoice chosen_kernel = choose_kernel();
+
+/**
+ * Counts the node identifiers common to two sorted arrays without duplicates.
+ *
+ * @param a        first array
+ * @param size_a   number of identifiers in the first array
+ * @param b        second array
+ * @param size_b   number of identifiers in the second array
+ *
+ * @return size of the intersection.
+ */
+size_t intersection_count( const NODE_ID* a, const size_t size_a, const NODE_ID* b, const size_t size_b )
+{
+	if( size_a == 0 || size_b == 0 || a[size_a-1] < b[0] || b[size_b-1] < a[0] )
+	{
+		return 0;
+	}
+	if( size_a * GALLOP_RATIO < size_b )
+	{
+		return intersection_count_gallop( a, size_a, b, size_b );
+	}
+	if( size_b * GALLOP_RATIO < size_a )
+	{
+		return intersection_count_gallop( b, size_b, a, size_a );
+	}
+	return chosen_kernel.kernel( a, size_a, b, size_b );
+}
+
+/**
+ * Counts the node identifiers common to two sorted arrays, giving up as soon 
+ * as the remaining identifiers cannot bring the count up to min_count.
+ *
+ * @return size of the intersection, or some value below min_count if it is smaller than min_count.
+ */
+size_t intersection_count_bounded( const NODE_ID* a, const size_t size_a, const NODE_ID* b, const size_t size_b, const size_t min_count )
+{
+	if( min(size_a, size_b) < min_count )
+	{
+		return 0;
+	}
+	size_t i = 0, j = 0, count = 0;
+	while( i < size_a && j < size_b )
+	{
+		if( a[i] < b[j] )
+		{
+			i++;
+			// one fewer identifier of a left to match
+			if( count + ( size_a - i ) < min_count )
+			{
+				return count;
+			}
+		}
+		else if( b[j] < a[i] )
+		{
+			j++;
+			if( count + ( size_b - j ) < min_count )
+			{
+				return count;
+			}
+		}
+		else
+		{
+			count++;
+			i++;
+			j++;
+		}
+	}
+	return count;
+}
+
+/**
+ * Returns the name of the kernel used for sets of similar size on this machine.
+ */
+const char* intersection_kernel_name()
+{
+	return chosen_kernel.name;
+}
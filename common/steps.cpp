@@ -0,0 +1,345 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "settings.h"
+#include "standard.h"
+#include "steps.h"
+
+// ----------------------------------------------------------------------------
+// STEP ARCHIVE FORMAT
+// ----------------------------------------------------------------------------
+//
+// A step archive holds the clusterings for a sequence of time steps in a
+// single file, using the native byte order of the machine that wrote it:
+//
+//   char      magic[8]                      STEP_ARCHIVE_MAGIC
+//   uint64_t  num_steps
+//   uint64_t  offsets[num_steps+1]          file position of each step
+//   ...       one binary clustering per step, in step order
+//
+// Each step is stored in the binary clustering format, so any step can be
+// read straight from a mapping of the archive.
+// ----------------------------------------------------------------------------
+
+static const char STEP_ARCHIVE_MAGIC[8] = { 'D', 'C', 'A', 'R', 'C', 'H', '0', '1' };
+
+// ------------------------------------------------------------------------------------------
+// Class: StepArchiveWriter
+// ------------------------------------------------------------------------------------------
+
+StepArchiveWriter::StepArchiveWriter() : m_num_steps(0)
+{
+}
+
+StepArchiveWriter::~StepArchiveWriter()
+{
+	if( m_fout.is_open() )
+	{
+		m_fout.close();
+	}
+}
+
+/**
+ * Creates a new archive which will hold the specified number of steps.
+ *
+ * @param fname       output file path
+ * @param num_steps   number of steps that will be added
+ */
+bool StepArchiveWriter::open( const string fname, const int num_steps )
+{
+	m_fout.open( fname.c_str(), ios::out | ios::binary | ios::trunc );
+	if( !m_fout )
+	{
+		return false;
+	}
+	m_num_steps = num_steps;
+	m_offsets.clear();
+	// header is filled in on close, once the step positions are known
+	m_offsets.push_back( sizeof(STEP_ARCHIVE_MAGIC) + (num_steps+2)*sizeof(uint64_t) );
+	vector<char> header( (size_t)m_offsets.back(), 0 );
+	m_fout.write( &header[0], header.size() );
+	return !m_fout.fail();
+}
+
+/**
+ * Appends the clustering for the next step to the archive.
+ */
+bool StepArchiveWriter::add( const Clustering &step_clustering )
+{
+	if( (int)m_offsets.size() > m_num_steps )
+	{
+		cerr << "Error: Too many steps added to archive" << endl;
+		return false;
+	}
+	if( !write_clustering_binary( m_fout, step_clustering ) )
+	{
+		return false;
+	}
+	m_offsets.push_back( (uint64_t)m_fout.tellp() );
+	return true;
+}
+
+/**
+ * Writes the step offset table and closes the archive.
+ */
+bool StepArchiveWriter::close()
+{
+	if( (int)m_offsets.size() != m_num_steps + 1 )
+	{
+		cerr << "Error: Archive expected " << m_num_steps << " steps, but " << (m_offsets.size()-1) << " were added" << endl;
+		m_fout.close();
+		return false;
+	}
+	uint64_t num_steps = (uint64_t)m_num_steps;
+	m_fout.seekp( 0, ios::beg );
+	m_fout.write( STEP_ARCHIVE_MAGIC, sizeof(STEP_ARCHIVE_MAGIC) );
+	m_fout.write( (const char*)&num_steps, sizeof(uint64_t) );
+	m_fout.write( (const char*)&m_offsets[0], m_offsets.size()*sizeof(uint64_t) );
+	m_fout.close();
+	return !m_fout.fail();
+}
+
+// ------------------------------------------------------------------------------------------
+// Class: StepSource
+// ------------------------------------------------------------------------------------------
+
+StepSource::StepSource() : m_offsets(NULL), m_num_steps(0)
+{
+}
+
+/**
+ * Reads steps from individual files, with the first file as the first step.
+ */
+void StepSource::set_files( const int count, char **fnames )
+{
+	m_archive.close();
+	m_archive_fname.clear();
+	m_offsets = NULL;
+	m_num_steps = 0;
+	m_fnames.assign( fnames, fnames + count );
+}
+
+/**
+ * Reads steps from an archive created by StepArchiveWriter. The archive is
+ * mapped once, and stays mapped until this source is destroyed.
+ *
+ * @return false if the archive could not be opened or is not valid.
+ */
+bool StepSource::open_archive( const string fname )
+{
+	m_fnames.clear();
+	m_archive_fname = fname;
+	m_offsets = NULL;
+	m_num_steps = 0;
+	if( !m_archive.open( fname ) )
+	{
+		return false;
+	}
+	const char* data = m_archive.data();
+	size_t size = m_archive.size();
+	const size_t header_size = sizeof(STEP_ARCHIVE_MAGIC) + sizeof(uint64_t);
+	if( size < header_size || memcmp( data, STEP_ARCHIVE_MAGIC, sizeof(STEP_ARCHIVE_MAGIC) ) != 0 )
+	{
+		cerr << "Error: " << fname << " is not a step archive" << endl;
+		return false;
+	}
+	uint64_t num_steps;
+	memcpy( &num_steps, data + sizeof(STEP_ARCHIVE_MAGIC), sizeof(uint64_t) );
+	if( num_steps >= ( size - header_size ) / sizeof(uint64_t) )
+	{
+		cerr << "Error: Corrupt step archive " << fname << endl;
+		return false;
+	}
+	m_offsets = (const uint64_t*)( data + header_size );
+	for( uint64_t i = 0; i < num_steps; i++ )
+	{
+		if( m_offsets[i] > m_offsets[i+1] || m_offsets[i+1] > size )
+		{
+			cerr << "Error: Corrupt step archive " << fname << endl;
+			m_offsets = NULL;
+			return false;
+		}
+	}
+	m_num_steps = (int)num_steps;
+	return true;
+}
+
+/**
+ * Returns the number of available steps.
+ */
+int StepSource::size() const
+{
+	if( m_offsets != NULL )
+	{
+		return m_num_steps;
+	}
+	return (int)m_fnames.size();
+}
+
+/**
+ * Returns a description of where the specified step is read from.
+ */
+string StepSource::name( const int step ) const
+{
+	if( m_offsets != NULL )
+	{
+		stringstream ss;
+		ss << m_archive_fname << " (step " << step << ")";
+		return ss.str();
+	}
+	return m_fnames[step-1];
+}
+
+/**
+ * Reads the clustering for the specified step, numbered from 1. Safe to call
+ * concurrently for different steps.
+ */
+bool StepSource::read( const int step, Clustering &step_clustering ) const
+{
+	if( step < 1 || step > size() )
+	{
+		return false;
+	}
+	if( m_offsets != NULL )
+	{
+		const char* data = m_archive.data() + m_offsets[step-1];
+		return read_clustering_binary( data, (size_t)( m_offsets[step] - m_offsets[step-1] ), step_clustering );
+	}
+	return read_clustering_mmap( m_fnames[step-1], DEFAULT_DELIM, step_clustering );
+}
+
+// ------------------------------------------------------------------------------------------
+// Class: StepPrefetcher
+// ------------------------------------------------------------------------------------------
+
+/**
+ * Starts reading the steps of the source in the background. At most one 
+ * step per reader, plus one more, is parsed ahead of the step being consumed.
+ *
+ * @param steps         the step source, which must outlive the prefetcher
+ * @param num_readers   number of reader threads, or 0 to read each step on demand
+ */
+StepPrefetcher::StepPrefetcher( const StepSource &steps, const int num_readers )
+	: m_steps(steps), m_next_read(1), m_next_delivered(1), m_stop(false)
+{
+	pthread_mutex_init( &m_lock, NULL );
+	pthread_cond_init( &m_changed, NULL );
+	if( num_readers < 1 )
+	{
+		return;
+	}
+	Slot empty;
+	empty.ready = false;
+	empty.ok = false;
+	m_slots.assign( num_readers + 1, empty );
+	for( int i = 0; i < num_readers; i++ )
+	{
+		pthread_t thread;
+		if( pthread_create( &thread, NULL, StepPrefetcher::run_reader, this ) != 0 )
+		{
+			cerr << "Warning: Failed to start step reader thread" << endl;
+			break;
+		}
+		m_readers.push_back( thread );
+	}
+	if( m_readers.empty() )
+	{
+		m_slots.clear();
+	}
+}
+
+StepPrefetcher::~StepPrefetcher()
+{
+	pthread_mutex_lock( &m_lock );
+	m_stop = true;
+	pthread_cond_broadcast( &m_changed );
+	pthread_mutex_unlock( &m_lock );
+	for( size_t i = 0; i < m_readers.size(); i++ )
+	{
+		pthread_join( m_readers[i], NULL );
+	}
+	pthread_cond_destroy( &m_changed );
+	pthread_mutex_destroy( &m_lock );
+}
+
+void* StepPrefetcher::run_reader( void* arg )
+{
+	((StepPrefetcher*)arg)->read_ahead();
+	return NULL;
+}
+
+void StepPrefetcher::read_ahead()
+{
+	const int capacity = (int)m_slots.size();
+	pthread_mutex_lock( &m_lock );
+	while( true )
+	{
+		// wait until the slot for the next unclaimed step has been consumed
+		while( !m_stop && m_next_read <= m_steps.size() && m_next_read >= m_next_delivered + capacity )
+		{
+			pthread_cond_wait( &m_changed, &m_lock );
+		}
+		if( m_stop || m_next_read > m_steps.size() )
+		{
+			break;
+		}
+		int step = m_next_read++;
+		pthread_mutex_unlock( &m_lock );
+		Clustering step_clustering;
+		bool ok = m_steps.read( step, step_clustering );
+		pthread_mutex_lock( &m_lock );
+		Slot &slot = m_slots[(step-1) % capacity];
+		slot.clustering.swap( step_clustering );
+		slot.ok = ok;
+		slot.ready = true;
+		pthread_cond_broadcast( &m_changed );
+	}
+	pthread_mutex_unlock( &m_lock );
+}
+
+/**
+ * Retrieves the clustering for the next step, waiting for a reader to 
+ * finish parsing it if necessary.
+ *
+ * @return false if the step could not be read, or there are no more steps.
+ */
+bool StepPrefetcher::next( Clustering &step_clustering )
+{
+	step_clustering.clear();
+	if( m_next_delivered > m_steps.size() )
+	{
+		return false;
+	}
+	if( m_slots.empty() )
+	{
+		return m_steps.read( m_next_delivered++, step_clustering );
+	}
+	pthread_mutex_lock( &m_lock );
+	Slot &slot = m_slots[(m_next_delivered-1) % m_slots.size()];
+	while( !slot.ready )
+	{
+		pthread_cond_wait( &m_changed, &m_lock );
+	}
+	step_clustering.swap( slot.clustering );
+	slot.ready = false;
+	bool ok = slot.ok;
+	m_next_delivered++;
+	pthread_cond_broadcast( &m_changed );
+	pthread_mutex_unlock( &m_lock );
+	return ok;
+}
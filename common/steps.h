@@ -0,0 +1,123 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef STEPS_H
+#define STEPS_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "clustering.h"
+#include "util.h"
+
+// ------------------------------------------------------------------------------------------
+// Class: StepArchiveWriter
+// ------------------------------------------------------------------------------------------
+
+/** builds a single archive file containing a sequence of step clusterings */
+class StepArchiveWriter
+{
+public:
+	StepArchiveWriter();
+	~StepArchiveWriter();
+
+	bool open( const string fname, const int num_steps );
+	bool add( const Clustering &step_clustering );
+	bool close();
+
+private:
+	ofstream m_fout;
+	vector<uint64_t> m_offsets;
+	int m_num_steps;
+};
+
+// ------------------------------------------------------------------------------------------
+// Class: StepSource
+// ------------------------------------------------------------------------------------------
+
+/** provides random access to step clusterings, either from individual files or a single archive */
+class StepSource
+{
+public:
+	StepSource();
+
+	void set_files( const int count, char **fnames );
+	bool open_archive( const string fname );
+
+	int size() const;
+	string name( const int step ) const;
+	bool read( const int step, Clustering &step_clustering ) const;
+
+private:
+	StepSource( const StepSource& );
+	StepSource& operator=( const StepSource& );
+
+	/** paths of individual step files */
+	vector<string> m_fnames;
+	/** path of the archive, if any */
+	string m_archive_fname;
+	/** the mapped archive */
+	MappedFile m_archive;
+	/** start of each step in the archive, followed by the end of the last step */
+	const uint64_t* m_offsets;
+	/** number of steps in the archive */
+	int m_num_steps;
+};
+
+// ------------------------------------------------------------------------------------------
+// Class: StepPrefetcher
+// ------------------------------------------------------------------------------------------
+
+/** delivers the steps of a source in order, while reader threads parse upcoming steps ahead */
+class StepPrefetcher
+{
+public:
+	StepPrefetcher( const StepSource &steps, const int num_readers );
+	~StepPrefetcher();
+
+	bool next( Clustering &step_clustering );
+
+private:
+	StepPrefetcher( const StepPrefetcher& );
+	StepPrefetcher& operator=( const StepPrefetcher& );
+
+	struct Slot
+	{
+		Clustering clustering;
+		bool ready;
+		bool ok;
+	};
+
+	static void* run_reader( void* arg );
+	void read_ahead();
+
+	/** source of the step clusterings */
+	const StepSource &m_steps;
+	/** parsed steps waiting to be delivered, indexed by step modulo the capacity */
+	vector<Slot> m_slots;
+	/** reader threads */
+	vector<pthread_t> m_readers;
+	/** next step to be claimed by a reader */
+	int m_next_read;
+	/** next step to be delivered */
+	int m_next_delivered;
+	/** set when the readers should exit */
+	bool m_stop;
+	pthread_mutex_t m_lock;
+	pthread_cond_t m_changed;
+};
+
+#endif // STEPS_H
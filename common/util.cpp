@@ -15,6 +15,10 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "standard.h"
 #include "util.h"
 
@@ -27,3 +31,66 @@ double diff_clock(clock_t clock1,clock_t clock2)
 	return (clock1 - clock2)/(CLOCKS_PER_SEC/1000);
 }
 
+
+
+// ---------------------------------------------------------------------------
+/// Memory-mapped files
+// ---------------------------------------------------------------------------
+
+MappedFile::MappedFile() : m_data(NULL), m_size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+/**
+ * Maps the specified file into memory for sequential reading. An empty file
+ * is opened successfully, but has no data.
+ *
+ * @param fname   input file path
+ *
+ * @return false if the file could not be opened or mapped.
+ */
+bool MappedFile::open( const string fname )
+{
+	close();
+	int fd = ::open( fname.c_str(), O_RDONLY );
+	if( fd < 0 )
+	{
+		return false;
+	}
+	struct stat st;
+	if( fstat( fd, &st ) != 0 )
+	{
+		::close(fd);
+		return false;
+	}
+	if( st.st_size > 0 )
+	{
+		void* addr = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if( addr == MAP_FAILED )
+		{
+			::close(fd);
+			return false;
+		}
+		madvise( addr, (size_t)st.st_size, MADV_SEQUENTIAL );
+		m_data = (const char*)addr;
+		m_size = (size_t)st.st_size;
+	}
+	// the mapping remains valid after the descriptor is closed
+	::close(fd);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if( m_data != NULL )
+	{
+		munmap( (void*)m_data, m_size );
+	}
+	m_data = NULL;
+	m_size = 0;
+}
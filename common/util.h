@@ -23,4 +23,29 @@
 // ---------------------------------------------------------------------------
 double diff_clock(clock_t clock1, clock_t clock2);
 
+// ---------------------------------------------------------------------------
+/// Memory-mapped files
+// ---------------------------------------------------------------------------
+
+/** read-only mapping of an entire file, released on close or destruction */
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open( const string fname );
+	void close();
+
+	const char* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+private:
+	MappedFile( const MappedFile& );
+	MappedFile& operator=( const MappedFile& );
+
+	const char* m_data;
+	size_t m_size;
+};
+
 #endif // UTIL_H
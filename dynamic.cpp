@@ -15,8 +15,14 @@
  * limitations under the License.
  */
 
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/stat.h>
 #include "common/standard.h"
+#include "common/util.h"
 #include "settings.h"
+#include "common/intersect.h"
 #include "dynamic.h"
 #include "extras.h"
 
@@ -24,23 +30,19 @@
 // Class: Timeline
 // ------------------------------------------------------------------------------------------
 
-Timeline::Timeline( vector<int> &m_history_step, vector<int> &history_cluster )
-	: m_history_step(m_history_step), m_history_cluster(history_cluster)
-{
-}
-
 int Timeline::last_observed() const
 {
-	return m_history_step.back();
+	uint64_t last_run = m_store->m_run_offsets[m_index+1] - 1;
+	return m_store->m_run_steps[last_run] + run_length( last_run ) - 1;
 }
 
 int Timeline::first_observed() const
 {
-	if( m_history_step.empty() )
+	if( size() == 0 )
 	{
 		return -1;
 	}
-	return m_history_step[0];
+	return m_store->m_run_steps[m_store->m_run_offsets[m_index]];
 }
 
 /**
@@ -48,27 +50,32 @@ int Timeline::first_observed() const
  */
 int Timeline::consecutive_length() const
 {
-	if( m_history_step.empty() )
+	if( size() == 0 )
 	{
 		return 0;
 	}
 	int max_consec = 1;
 	int cur_consec = 0;
 	int last_step = 0;
-	for( int i = 0; i < m_history_step.size(); i++ )
+	int i = 0;
+	for( uint64_t run = m_store->m_run_offsets[m_index]; run < m_store->m_run_offsets[m_index+1]; run++ )
 	{
-		int step = m_history_step[i];
-		// First or consecutive?
-		if( i == 0 || step == last_step + 1 )
-		{
-			cur_consec++;
-		}
-		else
+		int length = run_length( run );
+		for( int k = 0; k < length; k++, i++ )
 		{
-			max_consec = max(cur_consec,max_consec);
-			cur_consec = 0;
+			int step = m_store->m_run_steps[run] + k;
+			// First or consecutive?
+			if( i == 0 || step == last_step + 1 )
+			{
+				cur_consec++;
+			}
+			else
+			{
+				max_consec = max(cur_consec,max_consec);
+				cur_consec = 0;
+			}
+			last_step = step;
 		}
-		last_step = step;
 	}
 	max_consec = max(cur_consec,max_consec);
 	return max_consec;
@@ -76,414 +83,1794 @@ int Timeline::consecutive_length() const
 
 bool Timeline::is_dead( const int step, const int death_age ) const
 {
-	return (step - m_history_step.back() - 1) >= death_age;
+	return (step - last_observed() - 1) >= death_age;
 }
 
 bool Timeline::is_observed( const int step ) const
 {
-	vector<int>::const_iterator result = find( m_history_step.begin(), m_history_step.end(), step );
-	return (result != m_history_step.end());
+	return position( step ) >= 0;
 }
 
 int Timeline::operator[] (const int step) const
 {
-	for( int i = 0; i < m_history_step.size(); i++ )
+	int i = position( step );
+	return i >= 0 ? m_store->m_clusters[m_store->m_observation_offsets[m_index] + i] : -1;
+}
+
+int Timeline::size() const
+{
+	return (int)( m_store->m_observation_offsets[m_index+1] - m_store->m_observation_offsets[m_index] );	
+}
+
+/**
+ * Copies the observations of this timeline, in the order they were added.
+ */
+void Timeline::history( vector<int> &history_step, vector<int> &history_cluster ) const
+{
+	history_step.clear();
+	for( uint64_t run = m_store->m_run_offsets[m_index]; run < m_store->m_run_offsets[m_index+1]; run++ )
+	{
+		int length = run_length( run );
+		for( int k = 0; k < length; k++ )
+		{
+			history_step.push_back( m_store->m_run_steps[run] + k );
+		}
+	}
+	history_cluster.assign( m_store->m_clusters.begin() + m_store->m_observation_offsets[m_index], 
+		m_store->m_clusters.begin() + m_store->m_observation_offsets[m_index+1] );
+}
+
+/**
+ * Returns the number of consecutive steps in a run of this timeline.
+ */
+int Timeline::run_length( const uint64_t run ) const
+{
+	int next = ( run + 1 < m_store->m_run_offsets[m_index+1] ) ? m_store->m_run_positions[run+1] : size();
+	return next - m_store->m_run_positions[run];
+}
+
+/**
+ * Returns the position of a step among the observations, or -1 if it was not observed.
+ */
+int Timeline::position( const int step ) const
+{
+	uint64_t first_word = m_store->m_bit_offsets[m_index];
+	uint64_t last_word = m_store->m_bit_offsets[m_index+1];
+	if( first_word < last_word )
+	{
+		int first = m_store->m_run_steps[m_store->m_run_offsets[m_index]];
+		if( step < first )
+		{
+			return -1;
+		}
+		uint64_t offset = (uint64_t)( step - first );
+		uint64_t w = first_word + offset / 64;
+		if( w >= last_word )
+		{
+			return -1;
+		}
+		uint64_t bit = 1ULL << ( offset % 64 );
+		if( !( m_store->m_step_bits[w] & bit ) )
+		{
+			return -1;
+		}
+		return m_store->m_step_ranks[w] + __builtin_popcountll( m_store->m_step_bits[w] & ( bit - 1 ) );
+	}
+	// a single run, or steps which are not increasing
+	for( uint64_t run = m_store->m_run_offsets[m_index]; run < m_store->m_run_offsets[m_index+1]; run++ )
 	{
-		if( m_history_step[i] == step )
+		int offset = step - m_store->m_run_steps[run];
+		if( offset >= 0 && offset < run_length( run ) )
 		{
-			return m_history_cluster[i];
+			return m_store->m_run_positions[run] + offset;
 		}
 	}
 	return -1;
 }
 
-int Timeline::size() const
+// ------------------------------------------------------------------------------------------
+// Class: TimelineStore
+// ------------------------------------------------------------------------------------------
+
+TimelineStore::TimelineStore()
+{
+	clear();
+}
+
+void TimelineStore::clear()
+{
+	m_observation_offsets.assign( 1, 0 );
+	m_run_offsets.assign( 1, 0 );
+	m_run_steps.clear();
+	m_run_positions.clear();
+	m_clusters.clear();
+	m_bit_offsets.assign( 1, 0 );
+	m_step_bits.clear();
+	m_step_ranks.clear();
+}
+
+/**
+ * Adds a timeline, starting a new run at each step which does not follow the previous one, 
+ * and indexes its steps if it has several runs and its steps are increasing.
+ */
+void TimelineStore::add( const int *history_step, const int *history_cluster, const int size )
+{
+	bool increasing = true;
+	size_t first_run = m_run_steps.size();
+	for( int i = 0; i < size; i++ )
+	{
+		if( i == 0 || history_step[i] != history_step[i-1] + 1 )
+		{
+			if( i > 0 && history_step[i] <= history_step[i-1] )
+			{
+				increasing = false;
+			}
+			m_run_steps.push_back( history_step[i] );
+			m_run_positions.push_back( i );
+		}
+	}
+	// a single run needs no index
+	if( increasing && m_run_steps.size() > first_run + 1 )
+	{
+		size_t first_word = m_step_bits.size();
+		uint64_t span = (uint64_t)( (long)history_step[size-1] - history_step[0] ) + 1;
+		m_step_bits.resize( first_word + ( span + 63 ) / 64, 0 );
+		for( int i = 0; i < size; i++ )
+		{
+			uint64_t offset = (uint64_t)( history_step[i] - history_step[0] );
+			m_step_bits[first_word + offset / 64] |= 1ULL << ( offset % 64 );
+		}
+		int rank = 0;
+		for( size_t w = first_word; w < m_step_bits.size(); w++ )
+		{
+			m_step_ranks.push_back( rank );
+			rank += __builtin_popcountll( m_step_bits[w] );
+		}
+	}
+	m_clusters.insert( m_clusters.end(), history_cluster, history_cluster + size );
+	m_observation_offsets.push_back( m_clusters.size() );
+	m_run_offsets.push_back( m_run_steps.size() );
+	m_bit_offsets.push_back( m_step_bits.size() );
+}
+
+void TimelineStore::add( const vector<int> &history_step, const vector<int> &history_cluster )
+{
+	add( history_step.empty() ? NULL : &history_step[0], history_cluster.empty() ? NULL : &history_cluster[0], (int)history_step.size() );
+}
+
+// ------------------------------------------------------------------------------------------
+// Class: StepIndex
+// ------------------------------------------------------------------------------------------
+
+/**
+ * Builds the index with a counting sort of all observations by step.
+ */
+void StepIndex::build( const TimelineStore &timelines )
+{
+	m_num_timelines = (uint64_t)timelines.size();
+	m_num_runs = (uint64_t)timelines.runs();
+	m_max_step = 0;
+	vector<int> history_step, history_cluster;
+	for( int dyn_index = 0; dyn_index < (int)timelines.size(); dyn_index++ )
+	{
+		if( timelines[dyn_index].size() > 0 )
+		{
+			m_max_step = max( m_max_step, timelines[dyn_index].last_observed() );
+		}
+	}
+	m_offsets.assign( m_max_step + 2, 0 );
+	for( int dyn_index = 0; dyn_index < (int)timelines.size(); dyn_index++ )
+	{
+		timelines[dyn_index].history( history_step, history_cluster );
+		for( size_t i = 0; i < history_step.size(); i++ )
+		{
+			m_offsets[history_step[i]+1]++;
+		}
+	}
+	for( int step = 1; step <= m_max_step + 1; step++ )
+	{
+		m_offsets[step] += m_offsets[step-1];
+	}
+	m_clusters.resize( m_offsets[m_max_step+1] );
+	m_timelines.resize( m_offsets[m_max_step+1] );
+	vector<uint64_t> next( m_offsets.begin(), m_offsets.end() - 1 );
+	for( int dyn_index = 0; dyn_index < (int)timelines.size(); dyn_index++ )
+	{
+		timelines[dyn_index].history( history_step, history_cluster );
+		for( size_t i = 0; i < history_step.size(); i++ )
+		{
+			uint64_t entry = next[history_step[i]]++;
+			m_clusters[entry] = history_cluster[i];
+			m_timelines[entry] = dyn_index;
+		}
+	}
+	// timelines are already in order within each step, so order by step community
+	vector< pair<int,int> > entries;
+	for( int step = 1; step <= m_max_step; step++ )
+	{
+		entries.clear();
+		for( uint64_t entry = m_offsets[step]; entry < m_offsets[step+1]; entry++ )
+		{
+			entries.push_back( make_pair( m_clusters[entry], m_timelines[entry] ) );
+		}
+		sort( entries.begin(), entries.end() );
+		for( size_t i = 0; i < entries.size(); i++ )
+		{
+			m_clusters[m_offsets[step]+i] = entries[i].first;
+			m_timelines[m_offsets[step]+i] = entries[i].second;
+		}
+	}
+}
+
+/**
+ * Returns true if every entry of a step, after step 0, refers to one of the given 
+ * number of step communities, numbered from 1. The entries are ordered by step 
+ * community, so only the first and last are checked.
+ */
+bool StepIndex::in_range( const int step, const size_t num_clusters ) const
 {
-	return (int)m_history_step.size();	
+	if( begin(step) == end(step) )
+	{
+		return true;
+	}
+	return cluster( begin(step) ) >= 1 && (size_t)cluster( end(step) - 1 ) <= num_clusters;
 }
 
 // ------------------------------------------------------------------------------------------
 // Class: DynamicCluster
 // ------------------------------------------------------------------------------------------
 
-DynamicCluster::DynamicCluster( DynamicCluster &sibling, const int step, const int step_cluster_index, Cluster &initial_front )
-	: Timeline()
+DynamicCluster::DynamicCluster( HistoryStore &store )
+	: m_store(&store), m_tail(-1), m_size(0), m_first(-1), m_last(-1), m_last_cluster(-1), m_offset(-1)
 {
-	// copy sibling up to previous time step
-	if( sibling.m_history_step.size() > 0 )
+}
+
+/**
+ * Creates a dynamic cluster split from a sibling at the current step, sharing 
+ * the sibling's history up to the previous time step.
+ */
+DynamicCluster::DynamicCluster( const DynamicCluster &sibling, const int step, const int step_cluster_index )
+	: m_store(sibling.m_store), m_tail(-1), m_size(0), m_first(-1), m_last(-1), m_last_cluster(-1), m_offset(-1)
+{
+	if( sibling.m_size > 0 )
 	{
-		m_history_step.resize(sibling.m_history_step.size()-1);
-		copy(sibling.m_history_step.begin(), sibling.m_history_step.end()-1, m_history_step.begin());
-		m_history_cluster.resize(sibling.m_history_cluster.size()-1);
-		copy(sibling.m_history_cluster.begin(), sibling.m_history_cluster.end()-1, m_history_cluster.begin());
+		m_tail = (*m_store)[sibling.m_tail].parent;
+		m_size = sibling.m_size - 1;
+		if( m_size > 0 )
+		{
+			m_first = sibling.m_first;
+		}
 	}
 	// and add unique
-	update( step, step_cluster_index, initial_front );
+	update( step, step_cluster_index );
 }
 	
-inline bool DynamicCluster::update( const int step, const int step_cluster_index, Cluster &initial_front ) 
+inline bool DynamicCluster::update( const int step, const int step_cluster_index ) 
 {
 	if( size() > 0 && step <= last_observed() )
 	{
 		cerr << "Warning: History out of sync. New step <= last step. (" << step << " < " << last_observed() << endl;
 		return false;
 	}
-	m_front = initial_front;
-	m_history_step.push_back( step );
-	m_history_cluster.push_back( step_cluster_index ); 
+	m_tail = m_store->append( m_tail, step, step_cluster_index );
+	m_last = step;
+	m_last_cluster = step_cluster_index;
+	if( m_size == 0 )
+	{
+		m_first = step;
+	}
+	m_size++;
 	return true;
 }
 
-Cluster &DynamicCluster::front()
+int DynamicCluster::last_observed() const
 {
-	return m_front;
+	return m_last;
 }
 
-// ------------------------------------------------------------------------------------------
-// Class: MatchingDynamicClusterer
-// ------------------------------------------------------------------------------------------
+/**
+ * Returns the index of the step cluster in which this community was last observed.
+ */
+int DynamicCluster::last_cluster() const
+{
+	return m_last_cluster;
+}
 
-MatchingDynamicClusterer::MatchingDynamicClusterer( const double matching_threshold, const int death_age ) 
-	: m_threshold(matching_threshold), m_death_age(death_age), m_step(0)
+int DynamicCluster::first_observed() const
 {
+	return m_first;
 }
 
-DynamicClustering &MatchingDynamicClusterer::find_clusters()
+int DynamicCluster::size() const
 {
-	return m_dynamic;
+	return m_size;
 }
 
-bool MatchingDynamicClusterer::add_clustering( Clustering &step_clustering )
+int DynamicCluster::consecutive_length() const
 {
-	m_step += 1;
-	/// First?
-	if( m_step == 1 )
+	TimelineStore single;
+	vector<int> history_step, history_cluster;
+	history( history_step, history_cluster );
+	single.add( history_step, history_cluster );
+	return single[0].consecutive_length();
+}
+
+bool DynamicCluster::is_observed( const int step ) const
+{
+	return (*this)[step] >= 0;
+}
+
+bool DynamicCluster::is_dead( const int step, const int death_age ) const
+{
+	return (step - last_observed() - 1) >= death_age;
+}
+
+int DynamicCluster::operator[] (const int step) const
+{
+	if( m_offset >= 0 )
 	{
-		return bootstrap(step_clustering);
+		TimelineStore single;
+		vector<int> history_step, history_cluster;
+		history( history_step, history_cluster );
+		single.add( history_step, history_cluster );
+		return single[0][step];
 	}
-	
-	/// Otherwise, try to match all
-	Clustering::iterator cit;
-	Clustering::iterator cend = step_clustering.end();
-	int step_cluster_index = 0;
-	vector<DynamicCluster> fresh;
-	PairVector matched_pairs;
-	for( cit = step_clustering.begin() ; cit != cend; cit++, step_cluster_index++ )
+	// steps decrease towards the root
+	for( int node = m_tail; node >= 0 && (*m_store)[node].step >= step; node = (*m_store)[node].parent )
 	{
-		vector<int> matches;
-		find_matches( *cit, matches );
-		// new community?
-		if( matches.empty() )
+		if( (*m_store)[node].step == step )
 		{
-			DynamicCluster dc;
-			dc.update( m_step, step_cluster_index, *cit );
-			fresh.push_back(dc);
-#ifdef DEBUG_MATCHING
-			cout << "T" << m_step << ": Birth: Community M" << (m_dynamic.size()+fresh.size()) << " from C" << step_cluster_index+1 << endl;
-#endif			
-		}
-		else
-		{
-			vector<int>::const_iterator iit;
-			for( iit = matches.begin() ; iit != matches.end(); iit++ )
-			{
-				pair<int,int> p(step_cluster_index,(*iit));
-				matched_pairs.push_back(p);
-			}
+			return (*m_store)[node].cluster;
 		}
 	}
-	
-	// Actually update existing dynamic communities now
-	set<int> matched_dynamic;
-	PairVector::const_iterator pit;
-	for( pit = matched_pairs.begin(); pit != matched_pairs.end(); pit++ )
+	return -1;
+}
+
+/**
+ * Copies the observations of this dynamic cluster, in order of step.
+ */
+void DynamicCluster::history( vector<int> &history_step, vector<int> &history_cluster ) const
+{
+	if( m_offset >= 0 )
 	{
-		int step_cluster_index = (*pit).first;
-		int dyn_cluster_index = (*pit).second;
-		// already processed this dynamic cluster?
-		if( matched_dynamic.count( dyn_cluster_index ) ) 
-		{
-			DynamicCluster dc( m_dynamic[dyn_cluster_index], m_step, step_cluster_index, step_clustering[step_cluster_index] );
-			fresh.push_back(dc);
-#ifdef DEBUG_MATCHING
-			cout << "T" << m_step << ": Split: Matched C" << (step_cluster_index+1) << " to M" << (dyn_cluster_index+1) << ". Splitting to M" << (m_dynamic.size()+fresh.size()) <<  endl;
-#endif
-		}
-		else
+		if( !m_store->read_spilled( m_offset, m_size, history_step, history_cluster ) )
 		{
-#ifdef DEBUG_MATCHING
-			cout << "T" << m_step << ": Continuation: Matched C" << (step_cluster_index+1) << " to M" << (dyn_cluster_index+1) << endl;
-#endif
-			m_dynamic[dyn_cluster_index].update( m_step, step_cluster_index, step_clustering[step_cluster_index] );
-			matched_dynamic.insert(dyn_cluster_index);
+			cerr << "Error: Failed to read spilled timeline" << endl;
+			history_step.clear();
+			history_cluster.clear();
 		}
+		return;
 	}
-	// And finally add any new dynamic communities
-	DynamicClustering::const_iterator dit;
-	for( dit = fresh.begin() ; dit != fresh.end(); dit++ )
+	history_step.resize( m_size );
+	history_cluster.resize( m_size );
+	int node = m_tail;
+	for( int i = m_size - 1; i >= 0; i-- )
 	{
-		m_dynamic.push_back(*dit);
+		history_step[i] = (*m_store)[node].step;
+		history_cluster[i] = (*m_store)[node].cluster;
+		node = (*m_store)[node].parent;
 	}
-	
+}
+
+/**
+ * Moves the history of this dynamic cluster to the store's archive. Its nodes 
+ * are released when the store is next compacted.
+ */
+bool DynamicCluster::spill()
+{
+	if( m_offset >= 0 || m_size == 0 )
+	{
+		return true;
+	}
+	long long offset = m_store->spill( m_tail, m_size );
+	if( offset < 0 )
+	{
+		return false;
+	}
+	m_offset = offset;
+	m_tail = -1;
 	return true;
 }
 
-bool MatchingDynamicClusterer::bootstrap( Clustering &step_clustering )
+// ------------------------------------------------------------------------------------------
+// Class: HistoryStore
+// ------------------------------------------------------------------------------------------
+
+HistoryStore::~HistoryStore()
 {
-	m_dynamic.clear();
-	Clustering::iterator cit;
-	Clustering::iterator cend = step_clustering.end();
-	int step_cluster_index = 0;
-	for( cit = step_clustering.begin() ; cit != cend; cit++, step_cluster_index++ )
+	if( m_archive.is_open() )
 	{
-		// if( (*cit).size() < MIN_CLUSTER_SIZE || (*cit).size() > MAX_CLUSTER_SIZE )
-		if( (*cit).size() < MIN_CLUSTER_SIZE )
-		{
-			continue;
-		}
-		DynamicCluster dc;
-		dc.update( m_step, step_cluster_index, *cit );
-		m_dynamic.push_back(dc);
-#ifdef DEBUG_MATCHING
-		cout << "T" << m_step << ": Birth: Community M" << m_dynamic.size() << endl;
-#endif			
+		m_archive.close();
+		remove( m_archive_fname.c_str() );
+	}
+}
+
+int HistoryStore::append( const int parent, const int step, const int step_cluster_index )
+{
+	HistoryNode node;
+	node.step = step;
+	node.cluster = step_cluster_index;
+	node.parent = parent;
+	m_nodes.push_back( node );
+	return (int)m_nodes.size() - 1;
+}
+
+/**
+ * Creates the file to which the histories of dead dynamic clusters are moved.
+ */
+bool HistoryStore::open_archive( const string fname )
+{
+	m_archive.open( fname.c_str(), ios::in | ios::out | ios::binary | ios::trunc );
+	if( !m_archive )
+	{
+		return false;
 	}
+	m_archive_fname = fname;
 	return true;
 }
 
-inline void MatchingDynamicClusterer::find_matches( const Cluster &step_cluster, vector<int> &matches )
+/**
+ * Appends a history to the archive, as its steps followed by its step cluster 
+ * indices, in order of step.
+ *
+ * @return the position of the history in the archive, or -1 on failure.
+ */
+long long HistoryStore::spill( const int tail, const int size )
 {
-	int size_step = (int)step_cluster.size();
-	if( size_step < MIN_CLUSTER_SIZE )
+	vector<int32_t> buf( 2 * size );
+	int node = tail;
+	for( int i = size - 1; i >= 0; i-- )
 	{
-		return;
+		buf[i] = m_nodes[node].step;
+		buf[size + i] = m_nodes[node].cluster;
+		node = m_nodes[node].parent;
+	}
+	m_archive.seekp( 0, ios::end );
+	long long offset = (long long)m_archive.tellp();
+	m_archive.write( (const char*)&buf[0], buf.size()*sizeof(int32_t) );
+	if( offset < 0 || !m_archive )
+	{
+		return -1;
+	}
+	m_spilled_nodes += size;
+	return offset;
+}
+
+bool HistoryStore::read_spilled( const long long offset, const int size, vector<int> &history_step, vector<int> &history_cluster ) const
+{
+	vector<int32_t> buf( 2 * size );
+	m_archive.seekg( offset, ios::beg );
+	m_archive.read( (char*)&buf[0], buf.size()*sizeof(int32_t) );
+	if( !m_archive )
+	{
+		m_archive.clear();
+		return false;
 	}
-	DynamicClustering::iterator dit;
-	DynamicClustering::iterator dend = m_dynamic.end();
-	int dyn_index = 0;
-	for( dit = m_dynamic.begin() ; dit != dend; dit++, dyn_index++ )
+	history_step.assign( buf.begin(), buf.begin() + size );
+	history_cluster.assign( buf.begin() + size, buf.end() );
+	return true;
+}
+
+/**
+ * Compaction is worthwhile once about half the arena has been spilled. Spilled 
+ * nodes may still be shared with live histories, so this is an upper bound.
+ */
+bool HistoryStore::should_compact() const
+{
+	return m_spilled_nodes > 0 && 2 * m_spilled_nodes >= m_nodes.size();
+}
+
+/**
+ * Rebuilds the arena from the histories which have not been spilled, so that 
+ * the nodes of spilled histories are freed. Shared ancestry is copied once.
+ */
+void HistoryStore::compact( vector<DynamicCluster> &dynamic )
+{
+	vector<HistoryNode> nodes;
+	vector<int> moved( m_nodes.size(), -1 );
+	vector<int> path;
+	vector<DynamicCluster>::iterator it;
+	for( it = dynamic.begin(); it != dynamic.end(); it++ )
 	{
-		// Dead?
-		if( m_death_age > 0 && m_dynamic[dyn_index].is_dead( m_step, m_death_age ) )
+		DynamicCluster& dc = *it;
+		if( dc.m_tail < 0 )
 		{
 			continue;
 		}
-		Cluster& front = (*dit).front();
-		int size_front = front.size();
-		set<NODE> tmp;
-     	set_intersection(step_cluster.begin(), step_cluster.end(), front.begin(), front.end(), insert_iterator< set < NODE > > (tmp,tmp.begin()) );
-		int inter = tmp.size();
-		if( inter == 0 )
+		// collect the nodes not yet moved, back to the root or to a moved ancestor
+		path.clear();
+		for( int node = dc.m_tail; node >= 0 && moved[node] < 0; node = m_nodes[node].parent )
 		{
-			continue;
+			path.push_back( node );
 		}
-#ifdef SIM_OVERLAP
-		double sim = (double)(inter)/min(size_step,size_front);
-#else
-		double sim = (double)(inter)/(size_step+size_front-inter);
-#endif
-		if( sim > m_threshold )
+		vector<int>::reverse_iterator pit;
+		for( pit = path.rbegin(); pit != path.rend(); pit++ )
+		{
+			HistoryNode node = m_nodes[*pit];
+			if( node.parent >= 0 )
+			{
+				node.parent = moved[node.parent];
+			}
+			moved[*pit] = (int)nodes.size();
+			nodes.push_back( node );
+		}
+		dc.m_tail = moved[dc.m_tail];
+	}
+	m_nodes.swap( nodes );
+	m_spilled_nodes = 0;
+}
+
+// ------------------------------------------------------------------------------------------
+// Similarity measures
+// ------------------------------------------------------------------------------------------
+
+bool parse_similarity( const string name, SimilarityMeasure &measure )
+{
+	if( name == "jaccard" )
+	{
+		measure = SIMILARITY_JACCARD;
+	}
+	else if( name == "overlap" )
+	{
+		measure = SIMILARITY_OVERLAP;
+	}
+	else if( name == "dice" )
+	{
+		measure = SIMILARITY_DICE;
+	}
+	else if( name == "cosine" )
+	{
+		measure = SIMILARITY_COSINE;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+const char* similarity_name( const SimilarityMeasure measure )
+{
+	switch( measure )
+	{
+		case SIMILARITY_OVERLAP: return "binary overlap";
+		case SIMILARITY_DICE: return "Dice";
+		case SIMILARITY_COSINE: return "cosine";
+		default: return "Jaccard";
+	}
+}
+
+/**
+ * Converts a threshold to the decimal fraction with the smallest denominator, 
+ * up to 10^9, which gives back the same value. Thresholds are written in 
+ * decimal, so for a value such as 0.3 a similarity of exactly 3/10 does not 
+ * exceed it, as when comparing the similarity as a double.
+ */
+Threshold make_threshold( const double threshold )
+{
+	Threshold t;
+	t.den = 1;
+	while( true )
+	{
+		t.num = (long long)floor( threshold * t.den + 0.5 );
+		if( (double)t.num / t.den == threshold || t.den >= 1000000000LL )
+		{
+			return t;
+		}
+		t.den *= 10;
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+// Class: MatchingDynamicClusterer
+// ------------------------------------------------------------------------------------------
+
+MatchingDynamicClusterer::MatchingDynamicClusterer( const double matching_threshold, const int death_age ) 
+	: m_threshold(matching_threshold), m_fraction(make_threshold(matching_threshold)), m_similarity(SIMILARITY_JACCARD), 
+	m_death_age(death_age), m_num_dead(0), m_num_births(0), m_num_splits(0), m_num_continuations(0), m_step(0), m_num_threads(1)
+{
+	if( m_death_age > 0 )
+	{
+		m_window.resize( m_death_age + 1 );
+	}
+}
+
+DynamicClustering &MatchingDynamicClusterer::find_clusters()
+{
+	return m_dynamic;
+}
+
+/**
+ * Sets the number of threads used to score step clusters. The results do 
+ * not depend on the number of threads.
+ */
+void MatchingDynamicClusterer::set_num_threads( const int num_threads )
+{
+	m_num_threads = max( 1, num_threads );
+}
+
+void MatchingDynamicClusterer::set_similarity( const SimilarityMeasure measure )
+{
+	m_similarity = measure;
+}
+
+/**
+ * Moves the timelines of dynamic clusters to a file as they die, rather than 
+ * keeping them in memory until they are written. The file is removed when the 
+ * clusterer is deleted.
+ */
+bool MatchingDynamicClusterer::set_archive( const string fname )
+{
+	return m_history.open_archive( fname );
+}
+
+/**
+ * Returns the current front of a dynamic cluster, the step cluster in which 
+ * it was last observed.
+ */
+const Cluster &MatchingDynamicClusterer::front( const int dyn_index ) const
+{
+	const DynamicCluster& dc = m_dynamic[dyn_index];
+	return m_window[window_slot( dc.last_observed() )][dc.last_cluster()];
+}
+
+/**
+ * Returns the position of a step in the window of retained clusterings. A 
+ * live dynamic cluster was last observed at most death_age steps ago, so the 
+ * window is a ring of death_age+1 clusterings, including the current step.
+ */
+int MatchingDynamicClusterer::window_slot( const int step ) const
+{
+	if( m_death_age > 0 )
+	{
+		return step % ( m_death_age + 1 );
+	}
+	return step - 1;
+}
+
+/**
+ * Takes over the clustering for the current step, by swapping it into the 
+ * window in place of the oldest step, whose clusters can no longer be fronts.
+ */
+Clustering &MatchingDynamicClusterer::retain( Clustering &step_clustering )
+{
+	int slot = window_slot( m_step );
+	if( slot >= (int)m_window.size() )
+	{
+		m_window.resize( slot + 1 );
+	}
+	m_window[slot].swap( step_clustering );
+	step_clustering.clear();
+	return m_window[slot];
+}
+
+/**
+ * Matches the clustering for the next step against the current fronts. The 
+ * clustering is moved into the clusterer, and is left empty.
+ */
+bool MatchingDynamicClusterer::add_clustering( Clustering &next_clustering )
+{
+	m_step += 1;
+	m_num_births = m_num_splits = m_num_continuations = 0;
+	// dead fronts are removed from any index before their step leaves the window
+	expire_dead();
+	begin_step( next_clustering );
+	Clustering& step_clustering = retain( next_clustering );
+	/// First?
+	if( m_step == 1 )
+	{
+		bool ok = bootstrap(step_clustering);
+		for( int dyn_index = 0; dyn_index < (int)m_dynamic.size(); dyn_index++ )
+		{
+			m_live.push_back( dyn_index );
+			observed( dyn_index );
+		}
+		m_num_births = (int)m_dynamic.size();
+		return ok;
+	}
+	
+	/// Otherwise, try to match all against the current fronts
+	int step_count = (int)step_clustering.size();
+	vector< vector<int> > step_matches( step_count );
+	vector<char> eligible( step_count, 0 );
+	match_all( step_clustering, step_matches, eligible );
+	matched( step_clustering, step_matches, eligible );
+
+	/// Now process the matches in order of step cluster
+	vector<DynamicCluster> fresh;
+	PairVector matched_pairs;
+	for( int step_cluster_index = 0; step_cluster_index < step_count; step_cluster_index++ )
+	{
+		if( !eligible[step_cluster_index] )
+		{
+			continue;
+		}
+		vector<int>& matches = step_matches[step_cluster_index];
+		// new community?
+		if( matches.empty() )
+		{
+			DynamicCluster dc( m_history );
+			dc.update( m_step, step_cluster_index );
+			fresh.push_back(dc);
+			m_num_births++;
+#ifdef DEBUG_MATCHING
+			cout << "T" << m_step << ": Birth: Community M" << (m_dynamic.size()+fresh.size()) << " from C" << step_cluster_index+1 << endl;
+#endif			
+		}
+		else
+		{
+			vector<int>::const_iterator iit;
+			for( iit = matches.begin() ; iit != matches.end(); iit++ )
+			{
+				pair<int,int> p(step_cluster_index,(*iit));
+				matched_pairs.push_back(p);
+			}
+		}
+	}
+	
+	// The first match of each dynamic cluster continues it, so take the fronts it 
+	// replaces out of any index together, before any fronts are added
+	set<int> matched_dynamic;
+	PairVector::const_iterator pit;
+	for( pit = matched_pairs.begin(); pit != matched_pairs.end(); pit++ )
+	{
+		if( matched_dynamic.insert( (*pit).second ).second )
+		{
+			front_removed( (*pit).second );
+		}
+	}
+	matched_dynamic.clear();
+	// Actually update existing dynamic communities now
+	for( pit = matched_pairs.begin(); pit != matched_pairs.end(); pit++ )
+	{
+		int step_cluster_index = (*pit).first;
+		int dyn_cluster_index = (*pit).second;
+		// already processed this dynamic cluster?
+		if( matched_dynamic.count( dyn_cluster_index ) ) 
+		{
+			DynamicCluster dc( m_dynamic[dyn_cluster_index], m_step, step_cluster_index );
+			fresh.push_back(dc);
+			m_num_splits++;
+#ifdef DEBUG_MATCHING
+			cout << "T" << m_step << ": Split: Matched C" << (step_cluster_index+1) << " to M" << (dyn_cluster_index+1) << ". Splitting to M" << (m_dynamic.size()+fresh.size()) <<  endl;
+#endif
+		}
+		else
+		{
+#ifdef DEBUG_MATCHING
+			cout << "T" << m_step << ": Continuation: Matched C" << (step_cluster_index+1) << " to M" << (dyn_cluster_index+1) << endl;
+#endif
+			m_dynamic[dyn_cluster_index].update( m_step, step_cluster_index );
+			observed( dyn_cluster_index );
+			matched_dynamic.insert(dyn_cluster_index);
+			m_num_continuations++;
+		}
+	}
+	// And finally add any new dynamic communities
+	DynamicClustering::const_iterator dit;
+	for( dit = fresh.begin() ; dit != fresh.end(); dit++ )
+	{
+		m_dynamic.push_back(*dit);
+		m_live.push_back( (int)m_dynamic.size() - 1 );
+		observed( (int)m_dynamic.size() - 1 );
+	}
+	
+	return true;
+}
+
+bool MatchingDynamicClusterer::bootstrap( Clustering &step_clustering )
+{
+	m_dynamic.clear();
+	Clustering::iterator cit;
+	Clustering::iterator cend = step_clustering.end();
+	int step_cluster_index = 0;
+	for( cit = step_clustering.begin() ; cit != cend; cit++, step_cluster_index++ )
+	{
+		// if( (*cit).size() < MIN_CLUSTER_SIZE || (*cit).size() > MAX_CLUSTER_SIZE )
+		if( (*cit).size() < MIN_CLUSTER_SIZE )
+		{
+			continue;
+		}
+		DynamicCluster dc( m_history );
+		dc.update( m_step, step_cluster_index );
+		m_dynamic.push_back(dc);
+#ifdef DEBUG_MATCHING
+		cout << "T" << m_step << ": Birth: Community M" << m_dynamic.size() << endl;
+#endif			
+	}
+	return true;
+}
+
+/** the share of the step clusters scored by one matching thread */
+struct MatchTask
+{
+	const MatchingDynamicClusterer* clusterer;
+	const Clustering* step_clustering;
+	vector< vector<int> >* step_matches;
+	vector<char>* eligible;
+	int first;
+	int stride;
+};
+
+void* MatchingDynamicClusterer::match_thread( void* arg )
+{
+	MatchTask* task = (MatchTask*)arg;
+	MatchBuffer buffer;
+	int step_count = (int)task->step_clustering->size();
+	for( int i = task->first; i < step_count; i += task->stride )
+	{
+		(*task->eligible)[i] = task->clusterer->find_matches( (*task->step_clustering)[i], (*task->step_matches)[i], buffer ) ? 1 : 0;
+	}
+	return NULL;
+}
+
+/**
+ * Finds the matches of every step cluster against the fronts as they were at 
+ * the end of the previous step. Each step cluster is scored independently, so 
+ * the clusters are shared between the threads in turn, each thread having its own buffer.
+ */
+void MatchingDynamicClusterer::match_all( const Clustering &step_clustering, vector< vector<int> > &step_matches, vector<char> &eligible ) const
+{
+	int step_count = (int)step_clustering.size();
+	int num_threads = min( m_num_threads, step_count );
+	if( num_threads <= 1 )
+	{
+		MatchBuffer buffer;
+		for( int i = 0; i < step_count; i++ )
+		{
+			eligible[i] = find_matches( step_clustering[i], step_matches[i], buffer ) ? 1 : 0;
+		}
+		return;
+	}
+	vector<MatchTask> tasks( num_threads );
+	vector<pthread_t> threads( num_threads );
+	for( int t = 0; t < num_threads; t++ )
+	{
+		tasks[t].clusterer = this;
+		tasks[t].step_clustering = &step_clustering;
+		tasks[t].step_matches = &step_matches;
+		tasks[t].eligible = &eligible;
+		tasks[t].first = t;
+		tasks[t].stride = num_threads;
+		pthread_create( &threads[t], NULL, match_thread, &tasks[t] );
+	}
+	for( int t = 0; t < num_threads; t++ )
+	{
+		pthread_join( threads[t], NULL );
+	}
+}
+
+/**
+ * Finds the dynamic clusters matching a step cluster, in ascending order.
+ *
+ * @return false if the step cluster should be ignored altogether.
+ */
+bool MatchingDynamicClusterer::find_matches( const Cluster &step_cluster, vector<int> &matches, MatchBuffer & ) const
+{
+	if( (int)step_cluster.size() < MIN_CLUSTER_SIZE )
+	{
+		return false;
+	}
+	switch( m_similarity )
+	{
+		case SIMILARITY_OVERLAP: score_fronts<OverlapSimilarity>( step_cluster, matches ); break;
+		case SIMILARITY_DICE: score_fronts<DiceSimilarity>( step_cluster, matches ); break;
+		case SIMILARITY_COSINE: score_fronts<CosineSimilarity>( step_cluster, matches ); break;
+		default: score_fronts<JaccardSimilarity>( step_cluster, matches ); break;
+	}
+	return true;
+}
+
+template <class Similarity>
+void MatchingDynamicClusterer::score_fronts( const Cluster &step_cluster, vector<int> &matches ) const
+{
+	long size_step = (long)step_cluster.size();
+	vector<int>::const_iterator lit;
+	vector<int>::const_iterator lend = m_live.end();
+	for( lit = m_live.begin() ; lit != lend; lit++ )
+	{
+		int dyn_index = *lit;
+		const Cluster& front = this->front( dyn_index );
+		long size_front = (long)front.size();
+		long inter = (long)intersection_count( step_cluster.data(), size_step, front.data(), size_front );
+		if( inter == 0 )
+		{
+			continue;
+		}
+		if( Similarity::exceeds( inter, size_step, size_front, m_fraction ) )
+		{
+			matches.push_back( dyn_index );
+		}
+	}
+}
+
+/**
+ * Indexes the front of a dynamic cluster observed at the current step, and 
+ * schedules it to be checked for death.
+ */
+void MatchingDynamicClusterer::observed( const int dyn_index )
+{
+	front_added( dyn_index );
+	if( m_death_age > 0 )
+	{
+		if( m_step >= (int)m_expiry.size() )
+		{
+			m_expiry.resize( m_step + 1 );
+		}
+		m_expiry[m_step].push_back( dyn_index );
+	}
+}
+
+/**
+ * Removes dynamic clusters which die at the current step from the live set and 
+ * from any index. Only clusters last observed exactly death_age+1 steps ago 
+ * can die now.
+ */
+void MatchingDynamicClusterer::expire_dead()
+{
+	int last_step = m_step - m_death_age - 1;
+	if( m_death_age <= 0 || last_step < 1 || last_step >= (int)m_expiry.size() )
+	{
+		return;
+	}
+	int expired = 0;
+	vector<int>::const_iterator it;
+	for( it = m_expiry[last_step].begin(); it != m_expiry[last_step].end(); it++ )
+	{
+		// still not observed since then?
+		if( m_dynamic[*it].last_observed() == last_step )
+		{
+			front_removed( *it );
+			if( m_history.has_archive() && !m_dynamic[*it].spill() )
+			{
+				cerr << "Warning: Failed to spill timeline of M" << (*it+1) << ". Keeping it in memory." << endl;
+			}
+			expired++;
+		}
+	}
+	vector<int>().swap( m_expiry[last_step] );
+	if( expired > 0 )
+	{
+		// keep the live set in ascending order, so that matches are found in order
+		vector<int>::iterator out = m_live.begin();
+		for( it = m_live.begin(); it != m_live.end(); it++ )
+		{
+			if( !m_dynamic[*it].is_dead( m_step, m_death_age ) )
+			{
+				*out++ = *it;
+			}
+		}
+		m_live.erase( out, m_live.end() );
+		m_num_dead += expired;
+		if( m_history.should_compact() )
+		{
+			m_history.compact( m_dynamic );
+		}
+	}
+}
+
+/**
+ * Returns counts describing the dynamic clusters after the latest step, without 
+ * visiting them. With a death age of 0 communities are never dropped from 
+ * matching, but, as for Timeline::is_dead, those not observed in the latest 
+ * step are counted as dead.
+ */
+TrackingStatus MatchingDynamicClusterer::status() const
+{
+	TrackingStatus status;
+	status.total = (int)m_dynamic.size();
+	status.live = (int)m_live.size();
+	status.births = m_num_births;
+	status.splits = m_num_splits;
+	status.continuations = m_num_continuations;
+	if( m_death_age > 0 )
+	{
+		status.dead = m_num_dead;
+	}
+	else
+	{
+		status.dead = status.total - ( status.births + status.splits + status.continuations );
+	}
+	return status;
+}
+
+void MatchingDynamicClusterer::begin_step( const Clustering & )
+{
+}
+
+void MatchingDynamicClusterer::front_added( const int )
+{
+}
+
+void MatchingDynamicClusterer::front_removed( const int )
+{
+}
+
+/**
+ * Called with the matches of all step clusters, before they are applied.
+ */
+void MatchingDynamicClusterer::matched( const Clustering &, const vector< vector<int> > &, const vector<char> & )
+{
+}
+
+/**
+ * Returns any statistics the engine gathered while matching, for logging.
+ */
+string MatchingDynamicClusterer::summary() const
+{
+	return "";
+}
+
+// ------------------------------------------------------------------------------------------
+// Class: IndexedMatchingDynamicClusterer
+// ------------------------------------------------------------------------------------------
+
+IndexedMatchingDynamicClusterer::IndexedMatchingDynamicClusterer( const double matching_threshold, const int death_age ) 
+	: MatchingDynamicClusterer( matching_threshold, death_age )
+{
+}
+
+void IndexedMatchingDynamicClusterer::set_front_size( const int dyn_index, const long size )
+{
+	if( dyn_index >= (int)m_front_sizes.size() )
+	{
+		m_front_sizes.resize( dyn_index + 1, 0 );
+	}
+	m_front_sizes[dyn_index] = size;
+}
+
+// ------------------------------------------------------------------------------------------
+// Class: MapMatchingDynamicClusterer
+// ------------------------------------------------------------------------------------------
+
+MapMatchingDynamicClusterer::MapMatchingDynamicClusterer( const double matching_threshold, const int death_age ) 
+	: IndexedMatchingDynamicClusterer( matching_threshold, death_age )
+{
+}
+
+void MapMatchingDynamicClusterer::begin_step( const Clustering & )
+{
+	/// The index is keyed by node, so make room for any nodes first seen in this step
+	m_postings.resize( node_dictionary().size() );
+	remove_stale();
+}
+
+/**
+ * Finds the dynamic clusters matching a step cluster using the index. 
+ * Intersection counts are kept only for the dynamic clusters touched by 
+ * the step cluster, and reset after scoring.
+ */
+bool MapMatchingDynamicClusterer::find_matches( const Cluster &step_cluster, vector<int> &matches, MatchBuffer &buffer ) const
+{
+	long size_step = (long)step_cluster.size();
+	if( size_step < MIN_CLUSTER_SIZE )
+	{
+		return false;
+	}
+	vector<int>& all_intersection = buffer.counts;
+	vector<int>& touched = buffer.touched;
+	if( all_intersection.size() < m_dynamic.size() )
+	{
+		all_intersection.resize( m_dynamic.size(), 0 );
+	}
+	// Compute all intersections
+	Cluster::const_iterator xit;
+	Cluster::const_iterator	xend = step_cluster.end();
+	for( xit = step_cluster.begin() ; xit != xend; xit++ )
+	{
+		const vector<int>& containing = m_postings[*xit];
+		vector<int>::const_iterator sit;
+		for ( sit = containing.begin(); sit != containing.end(); sit++ )
+		{
+			if( all_intersection[(*sit)]++ == 0 )
+			{
+				touched.push_back( *sit );
+			}
+		}
+	}
+	switch( m_similarity )
+	{
+		case SIMILARITY_OVERLAP: score_touched<OverlapSimilarity>( size_step, matches, buffer ); break;
+		case SIMILARITY_DICE: score_touched<DiceSimilarity>( size_step, matches, buffer ); break;
+		case SIMILARITY_COSINE: score_touched<CosineSimilarity>( size_step, matches, buffer ); break;
+		default: score_touched<JaccardSimilarity>( size_step, matches, buffer ); break;
+	}
+	return true;
+}
+
+/**
+ * Finds matches among the dynamic clusters touched by a step cluster, in 
+ * order of dynamic cluster, and resets their counts.
+ */
+template <class Similarity>
+void MapMatchingDynamicClusterer::score_touched( const long size_step, vector<int> &matches, MatchBuffer &buffer ) const
+{
+	vector<int>& all_intersection = buffer.counts;
+	vector<int>& touched = buffer.touched;
+	sort( touched.begin(), touched.end() );
+	vector<int>::const_iterator tit;
+	for( tit = touched.begin(); tit != touched.end(); tit++ )
+	{
+		int dyn_index = *tit;
+		if( Similarity::exceeds( all_intersection[dyn_index], size_step, m_front_sizes[dyn_index], m_fraction ) )
+		{
+			matches.push_back( dyn_index );
+		}
+		all_intersection[dyn_index] = 0;
+	}
+	touched.clear();
+}
+
+/**
+ * Adds the current front of a dynamic cluster to the index of nodes, once any 
+ * fronts removed before it are gone from the index.
+ */
+void MapMatchingDynamicClusterer::front_added( const int dyn_index )
+{
+	remove_stale();
+	const Cluster& front = this->front( dyn_index );
+	set_front_size( dyn_index, (long)front.size() );
+	Cluster::const_iterator fit;
+	Cluster::const_iterator	fend = front.end();
+	for( fit = front.begin() ; fit != fend; fit++ )
+	{
+		m_postings[*fit].push_back(dyn_index);
+	}
+}
+
+/**
+ * Marks the entries for the current front of a dynamic cluster as stale. They 
+ * stay in the index until the next front is added or the next step begins.
+ */
+void MapMatchingDynamicClusterer::front_removed( const int dyn_index )
+{
+	// already removed?
+	if( m_front_sizes[dyn_index] == 0 )
+	{
+		return;
+	}
+	const Cluster& front = this->front( dyn_index );
+	if( dyn_index >= (int)m_stale.size() )
+	{
+		m_stale.resize( m_dynamic.size(), 0 );
+	}
+	m_stale[dyn_index] = 1;
+	m_stale_clusters.push_back( dyn_index );
+	if( m_node_stale.size() < m_postings.size() )
+	{
+		m_node_stale.resize( m_postings.size(), 0 );
+	}
+	Cluster::const_iterator fit;
+	Cluster::const_iterator	fend = front.end();
+	for( fit = front.begin() ; fit != fend; fit++ )
+	{
+		if( !m_node_stale[*fit] )
+		{
+			m_node_stale[*fit] = 1;
+			m_stale_nodes.push_back( *fit );
+		}
+	}
+	m_front_sizes[dyn_index] = 0;
+}
+
+/**
+ * Removes all stale entries from the index. The postings of each node are 
+ * compacted once, however many of their entries are stale, so removing a 
+ * batch of fronts costs no more than one pass over the postings they touch.
+ */
+void MapMatchingDynamicClusterer::remove_stale()
+{
+	if( m_stale_clusters.empty() )
+	{
+		return;
+	}
+	// clusters added since the last removal may be in the postings too
+	m_stale.resize( m_dynamic.size(), 0 );
+	for( vector<NODE_ID>::const_iterator nit = m_stale_nodes.begin(); nit != m_stale_nodes.end(); nit++ )
+	{
+		m_node_stale[*nit] = 0;
+		vector<int>& containing = m_postings[*nit];
+		vector<int>::iterator out = containing.begin();
+		for( vector<int>::const_iterator sit = containing.begin(); sit != containing.end(); sit++ )
+		{
+			if( !m_stale[*sit] )
+			{
+				*out++ = *sit;
+			}
+		}
+		containing.erase( out, containing.end() );
+	}
+	for( vector<int>::const_iterator it = m_stale_clusters.begin(); it != m_stale_clusters.end(); it++ )
+	{
+		m_stale[*it] = 0;
+	}
+	m_stale_clusters.clear();
+	m_stale_nodes.clear();
+}
+
+
+// ------------------------------------------------------------------------------------------
+// Class: PrefixMatchingDynamicClusterer
+// ------------------------------------------------------------------------------------------
+
+PrefixMatchingDynamicClusterer::PrefixMatchingDynamicClusterer( const double matching_threshold, const int death_age ) 
+	: MapMatchingDynamicClusterer( matching_threshold, death_age )
+{
+}
+
+bool PrefixMatchingDynamicClusterer::find_matches( const Cluster &step_cluster, vector<int> &matches, MatchBuffer &buffer ) const
+{
+	if( (long)step_cluster.size() < MIN_CLUSTER_SIZE )
+	{
+		return false;
+	}
+	switch( m_similarity )
+	{
+		case SIMILARITY_OVERLAP: match_prefix<OverlapSimilarity>( step_cluster, matches, buffer ); break;
+		case SIMILARITY_DICE: match_prefix<DiceSimilarity>( step_cluster, matches, buffer ); break;
+		case SIMILARITY_COSINE: match_prefix<CosineSimilarity>( step_cluster, matches, buffer ); break;
+		default: match_prefix<JaccardSimilarity>( step_cluster, matches, buffer ); break;
+	}
+	return true;
+}
+
+template <class Similarity>
+void PrefixMatchingDynamicClusterer::match_prefix( const Cluster &step_cluster, vector<int> &matches, MatchBuffer &buffer ) const
+{
+	long size_step = (long)step_cluster.size();
+	long length = size_step - (long)Similarity::min_overlap_any( size_step, m_fraction ) + 1;
+	if( length <= 0 )
+	{
+		return;
+	}
+	length = min( length, size_step );
+	/// The prefix is made of the nodes with the shortest postings
+	vector<unsigned long long>& keys = buffer.keys;
+	keys.clear();
+	Cluster::const_iterator xit;
+	for( xit = step_cluster.begin() ; xit != step_cluster.end(); xit++ )
+	{
+		keys.push_back( ( (unsigned long long)m_postings[*xit].size() << 32 ) | *xit );
+	}
+	if( length < size_step )
+	{
+		nth_element( keys.begin(), keys.begin() + length, keys.end() );
+	}
+	/// Count the nodes each front shares with the prefix
+	vector<int>& prefix_intersection = buffer.counts;
+	vector<int>& touched = buffer.touched;
+	if( prefix_intersection.size() < m_dynamic.size() )
+	{
+		prefix_intersection.resize( m_dynamic.size(), 0 );
+	}
+	for( long i = 0; i < length; i++ )
+	{
+		const vector<int>& containing = m_postings[(NODE_ID)( keys[i] & 0xffffffffULL )];
+		vector<int>::const_iterator sit;
+		for ( sit = containing.begin(); sit != containing.end(); sit++ )
+		{
+			if( prefix_intersection[(*sit)]++ == 0 )
+			{
+				touched.push_back( *sit );
+			}
+		}
+	}
+	/// Then verify the candidates, in order of dynamic community
+	long rest = size_step - length;
+	sort( touched.begin(), touched.end() );
+	vector<int>::const_iterator tit;
+	for( tit = touched.begin(); tit != touched.end(); tit++ )
+	{
+		int dyn_index = *tit;
+		long shared = prefix_intersection[dyn_index];
+		prefix_intersection[dyn_index] = 0;
+		long size_front = m_front_sizes[dyn_index];
+		// could they match if the rest of the step cluster were all in the front? 
+		// This also skips fronts too small or too large to match at all.
+		long most = min( min( size_step, size_front ), shared + rest );
+		if( !Similarity::exceeds( most, size_step, size_front, m_fraction ) )
+		{
+			continue;
+		}
+		// smallest intersection which exceeds the threshold
+		long low = 1, high = most;
+		while( low < high )
+		{
+			long middle = low + ( high - low ) / 2;
+			if( Similarity::exceeds( middle, size_step, size_front, m_fraction ) )
+			{
+				high = middle;
+			}
+			else
+			{
+				low = middle + 1;
+			}
+		}
+		long inter = shared;
+		if( rest > 0 )
+		{
+			const Cluster& front = this->front( dyn_index );
+			inter = (long)intersection_count_bounded( step_cluster.data(), size_step, front.data(), size_front, low );
+		}
+		if( inter >= low )
+		{
+			matches.push_back( dyn_index );
+		}
+	}
+	touched.clear();
+}
+
+// ------------------------------------------------------------------------------------------
+// Class: LshMatchingDynamicClusterer
+// ------------------------------------------------------------------------------------------
+
+static inline unsigned long long mix_hash( unsigned long long h )
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+LshMatchingDynamicClusterer::LshMatchingDynamicClusterer( const double matching_threshold, const int death_age, const int bands, const int rows, const int recall_sample ) 
+	: IndexedMatchingDynamicClusterer( matching_threshold, death_age ), m_bands(bands), m_rows(rows), m_buckets(bands),
+	m_recall_sample(recall_sample), m_sampled(0), m_exact_matches(0), m_found_matches(0)
+{
+	/// fixed seeds, so that runs are repeatable
+	for( int i = 0; i < m_bands * m_rows; i++ )
+	{
+		m_hash_a.push_back( mix_hash( 2*i + 1 ) | 1 );
+		m_hash_b.push_back( mix_hash( 2*i + 2 ) );
+	}
+}
+
+/**
+ * Hashes the original identifiers of any nodes first seen in this step. Dense 
+ * identifiers are assigned in whatever order the readers meet the nodes, so 
+ * hashing them would make the signatures differ between runs.
+ */
+void LshMatchingDynamicClusterer::begin_step( const Clustering & )
+{
+	NODE_ID first = (NODE_ID)m_node_hashes.size();
+	NODE_ID count = node_dictionary().size();
+	if( count <= first )
+	{
+		return;
+	}
+	vector<NODE_ID> ids( count - first );
+	for( NODE_ID i = 0; i < count - first; i++ )
+	{
+		ids[i] = first + i;
+	}
+	vector<NODE> nodes( ids.size() );
+	node_dictionary().external( &ids[0], ids.size(), &nodes[0] );
+	for( size_t i = 0; i < nodes.size(); i++ )
+	{
+		m_node_hashes.push_back( mix_hash( (unsigned long long)nodes[i] ) );
+	}
+}
+
+/**
+ * Computes the MinHash signature of a cluster and hashes each of its bands.
+ */
+void LshMatchingDynamicClusterer::band_keys( const Cluster &cluster, unsigned long long* keys ) const
+{
+	int num_hashes = m_bands * m_rows;
+	vector<unsigned int> signature( num_hashes, 0xffffffffU );
+	Cluster::const_iterator it;
+	for( it = cluster.begin() ; it != cluster.end(); it++ )
+	{
+		unsigned long long x = m_node_hashes[*it];
+		for( int i = 0; i < num_hashes; i++ )
+		{
+			unsigned int h = (unsigned int)( ( m_hash_a[i] * x + m_hash_b[i] ) >> 32 );
+			if( h < signature[i] )
+			{
+				signature[i] = h;
+			}
+		}
+	}
+	for( int band = 0; band < m_bands; band++ )
+	{
+		unsigned long long key = band;
+		for( int row = 0; row < m_rows; row++ )
+		{
+			key = mix_hash( key ^ signature[band*m_rows+row] );
+		}
+		keys[band] = key;
+	}
+}
+
+void LshMatchingDynamicClusterer::front_added( const int dyn_index )
+{
+	set_front_size( dyn_index, (long)front( dyn_index ).size() );
+	if( (size_t)( dyn_index + 1 ) * m_bands > m_front_keys.size() )
+	{
+		m_front_keys.resize( (size_t)( dyn_index + 1 ) * m_bands );
+	}
+	unsigned long long* keys = &m_front_keys[(size_t)dyn_index * m_bands];
+	band_keys( front( dyn_index ), keys );
+	for( int band = 0; band < m_bands; band++ )
+	{
+		m_buckets[band][keys[band]].push_back( dyn_index );
+	}
+}
+
+void LshMatchingDynamicClusterer::front_removed( const int dyn_index )
+{
+	const unsigned long long* keys = &m_front_keys[(size_t)dyn_index * m_bands];
+	for( int band = 0; band < m_bands; band++ )
+	{
+		map<unsigned long long, vector<int> >::iterator bit = m_buckets[band].find( keys[band] );
+		if( bit == m_buckets[band].end() )
+		{
+			continue;
+		}
+		vector<int>& bucket = (*bit).second;
+		vector<int>::iterator sit = find( bucket.begin(), bucket.end(), dyn_index );
+		if( sit != bucket.end() )
+		{
+			*sit = bucket.back();
+			bucket.pop_back();
+		}
+		if( bucket.empty() )
+		{
+			m_buckets[band].erase( bit );
+		}
+	}
+	m_front_sizes[dyn_index] = 0;
+}
+
+bool LshMatchingDynamicClusterer::find_matches( const Cluster &step_cluster, vector<int> &matches, MatchBuffer &buffer ) const
+{
+	if( (long)step_cluster.size() < MIN_CLUSTER_SIZE )
+	{
+		return false;
+	}
+	switch( m_similarity )
+	{
+		case SIMILARITY_OVERLAP: verify_candidates<OverlapSimilarity>( step_cluster, matches, buffer ); break;
+		case SIMILARITY_DICE: verify_candidates<DiceSimilarity>( step_cluster, matches, buffer ); break;
+		case SIMILARITY_COSINE: verify_candidates<CosineSimilarity>( step_cluster, matches, buffer ); break;
+		default: verify_candidates<JaccardSimilarity>( step_cluster, matches, buffer ); break;
+	}
+	return true;
+}
+
+/**
+ * Collects the fronts sharing a bucket with the step cluster in any band,
+ * and keeps those whose exact similarity exceeds the threshold.
+ */
+template <class Similarity>
+void LshMatchingDynamicClusterer::verify_candidates( const Cluster &step_cluster, vector<int> &matches, MatchBuffer &buffer ) const
+{
+	long size_step = (long)step_cluster.size();
+	vector<int>& seen = buffer.counts;
+	vector<int>& touched = buffer.touched;
+	if( seen.size() < m_dynamic.size() )
+	{
+		seen.resize( m_dynamic.size(), 0 );
+	}
+	buffer.keys.resize( m_bands );
+	band_keys( step_cluster, &buffer.keys[0] );
+	for( int band = 0; band < m_bands; band++ )
+	{
+		map<unsigned long long, vector<int> >::const_iterator bit = m_buckets[band].find( buffer.keys[band] );
+		if( bit == m_buckets[band].end() )
+		{
+			continue;
+		}
+		vector<int>::const_iterator sit;
+		for( sit = (*bit).second.begin(); sit != (*bit).second.end(); sit++ )
+		{
+			if( seen[*sit] == 0 )
+			{
+				seen[*sit] = 1;
+				touched.push_back( *sit );
+			}
+		}
+	}
+	sort( touched.begin(), touched.end() );
+	vector<int>::const_iterator tit;
+	for( tit = touched.begin(); tit != touched.end(); tit++ )
+	{
+		int dyn_index = *tit;
+		seen[dyn_index] = 0;
+		long size_front = m_front_sizes[dyn_index];
+		if( !Similarity::exceeds( min( size_step, size_front ), size_step, size_front, m_fraction ) )
+		{
+			continue;
+		}
+		const Cluster& front = this->front( dyn_index );
+		long inter = (long)intersection_count( step_cluster.data(), size_step, front.data(), size_front );
+		if( inter > 0 && Similarity::exceeds( inter, size_step, size_front, m_fraction ) )
 		{
 			matches.push_back( dyn_index );
 		}
 	}
+	touched.clear();
+}
+
+/**
+ * Measures recall by matching an evenly spread sample of the step clusters 
+ * exactly, against every live front, and counting how many of the exact 
+ * matches were found.
+ */
+void LshMatchingDynamicClusterer::matched( const Clustering &step_clustering, const vector< vector<int> > &step_matches, const vector<char> &eligible )
+{
+	if( m_recall_sample <= 0 )
+	{
+		return;
+	}
+	int eligible_count = (int)count( eligible.begin(), eligible.end(), 1 );
+	int stride = max( 1, eligible_count / m_recall_sample );
+	int position = 0;
+	for( int i = 0; i < (int)step_clustering.size(); i++ )
+	{
+		if( !eligible[i] || ( position++ % stride ) != 0 )
+		{
+			continue;
+		}
+		vector<int> exact;
+		switch( m_similarity )
+		{
+			case SIMILARITY_OVERLAP: score_fronts<OverlapSimilarity>( step_clustering[i], exact ); break;
+			case SIMILARITY_DICE: score_fronts<DiceSimilarity>( step_clustering[i], exact ); break;
+			case SIMILARITY_COSINE: score_fronts<CosineSimilarity>( step_clustering[i], exact ); break;
+			default: score_fronts<JaccardSimilarity>( step_clustering[i], exact ); break;
+		}
+		vector<int> found;
+		set_intersection( exact.begin(), exact.end(), step_matches[i].begin(), step_matches[i].end(), back_inserter( found ) );
+		m_sampled++;
+		m_exact_matches += (long)exact.size();
+		m_found_matches += (long)found.size();
+	}
+}
+
+string LshMatchingDynamicClusterer::summary() const
+{
+	stringstream ss;
+	if( m_recall_sample <= 0 )
+	{
+		return ss.str();
+	}
+	ss << "LSH recall on " << m_sampled << " sampled step communities: ";
+	if( m_exact_matches == 0 )
+	{
+		ss << "no exact matches in sample";
+	}
+	else
+	{
+		ss << m_found_matches << " of " << m_exact_matches << " exact matches found (" << ( 100.0 * m_found_matches ) / m_exact_matches << "%)";
+	}
+	return ss.str();
 }
 
 // ------------------------------------------------------------------------------------------
-// Class: MapMatchingDynamicClusterer
+// Matching engines
 // ------------------------------------------------------------------------------------------
 
-MapMatchingDynamicClusterer::MapMatchingDynamicClusterer( const double matching_threshold, const int death_age ) 
-	: MatchingDynamicClusterer( matching_threshold, death_age )
+static MatchingDynamicClusterer* create_brute( const double matching_threshold, const int death_age, const EngineOptions & )
 {
+	return new MatchingDynamicClusterer( matching_threshold, death_age );
 }
 
-bool MapMatchingDynamicClusterer::add_clustering( Clustering &step_clustering )
+static MatchingDynamicClusterer* create_map( const double matching_threshold, const int death_age, const EngineOptions & )
 {
-	m_step += 1;
-	/// First?
-	if( m_step == 1 )
-	{
-		return bootstrap(step_clustering);
-	}
-	
-	int step_cluster_index = 0;
+	return new MapMatchingDynamicClusterer( matching_threshold, death_age );
+}
+
+static MatchingDynamicClusterer* create_prefix( const double matching_threshold, const int death_age, const EngineOptions & )
+{
+	return new PrefixMatchingDynamicClusterer( matching_threshold, death_age );
+}
+
+static MatchingDynamicClusterer* create_lsh( const double matching_threshold, const int death_age, const EngineOptions &options )
+{
+	return new LshMatchingDynamicClusterer( matching_threshold, death_age, options.bands, options.rows, options.recall_sample );
+}
+
+static const MatchingEngine engines[] = 
+{
+	{ "brute", "brute-force", create_brute, true },
+	{ "map", "map-based", create_map, true },
+	{ "prefix", "prefix-filtering", create_prefix, true },
+	{ "lsh", "approximate MinHash LSH", create_lsh, false },
+};
+static const int num_engines = sizeof(engines)/sizeof(engines[0]);
 
-	/// Build a map of Nodes -> Dynamic Communities containing those nodes
-	map<NODE,set<int> > fastmap;
-	DynamicClustering::iterator dit;
-	DynamicClustering::iterator dend = m_dynamic.end();
-	int dyn_count = (int)m_dynamic.size();
-	int dyn_index = 0;
-	long* dyn_sizes = new long[dyn_count+1];
-	for( dit = m_dynamic.begin() ; dit != dend; dit++, dyn_index++ )
+/**
+ * Finds a matching engine by name, returning NULL if there is none.
+ */
+const MatchingEngine* find_engine( const string name )
+{
+	for( int i = 0; i < num_engines; i++ )
 	{
-		// Dead?
-		if( m_death_age > 0 && m_dynamic[dyn_index].is_dead( m_step, m_death_age ) )
-		{
-			dyn_sizes[dyn_index] = 0;
-			continue;
-		}
-		Cluster& front = (*dit).front();
-		dyn_sizes[dyn_index] = (long)front.size();
-		Cluster::const_iterator fit;
-		Cluster::const_iterator	fend = front.end();
-		for( fit = front.begin() ; fit != fend; fit++ )
+		if( name == engines[i].name )
 		{
-			NODE node_index = *fit;
-			if( !fastmap.count( node_index ) )
-			{
-				set<int> first;
-				first.insert(dyn_index);
-				fastmap.insert( make_pair(node_index,first) );
-			}
-			else
-			{
-				fastmap[node_index].insert(dyn_index);
-			}
+			return &engines[i];
 		}
-	}	
+	}
+	return NULL;
+}
 
-	/// Now try to match all
-	int* all_intersection = new int[dyn_count+1];
-	vector<DynamicCluster> fresh;
-	PairVector matched_pairs;
-	map<NODE,set<int> >::const_iterator mend = fastmap.end();
-	Clustering::iterator cit;
-	Clustering::iterator cend = step_clustering.end();
-	for( cit = step_clustering.begin() ; cit != cend; cit++, step_cluster_index++ )
+/**
+ * Returns the names of all matching engines, separated by commas.
+ */
+string engine_names()
+{
+	string names;
+	for( int i = 0; i < num_engines; i++ )
 	{
-		long size_step = (long)(*cit).size();
-		if( size_step < MIN_CLUSTER_SIZE )
-		{
-			continue;
-		}
-		// Compute all intersections
-		for( dyn_index = 0; dyn_index < dyn_count; dyn_index++)
-		{
-			all_intersection[dyn_index] = 0;
-		}
-		Cluster::const_iterator xit;
-		Cluster::const_iterator	xend = (*cit).end();
-		for( xit = (*cit).begin() ; xit != xend; xit++ )
-		{
-			NODE node_index = *xit;
-			map<NODE,set<int> >::const_iterator mit = fastmap.find(node_index);
-			if( mit != mend )
-			{
-				set<int>::const_iterator sit;
-				for ( sit = fastmap[node_index].begin(); sit != fastmap[node_index].end(); sit++ )
-				{
-					all_intersection[(*sit)]++;
-				}
-			}
-		}
-		// Find matches
-		vector<int> matches;
-		for( dyn_index = 0; dyn_index < dyn_count; dyn_index++)
+		if( i > 0 )
 		{
-			if( dyn_sizes[dyn_index] == 0 || all_intersection[dyn_index] == 0 )
-			{
-				continue;
-			}
-#ifdef SIM_OVERLAP
-			double sim = ((double)(all_intersection[dyn_index]))/min(size_step,dyn_sizes[dyn_index]);
-#else
-			double sim = ((double)(all_intersection[dyn_index]))/(size_step+dyn_sizes[dyn_index]-all_intersection[dyn_index]);
-#endif
-			if( sim > m_threshold )
-			{
-				matches.push_back( dyn_index );
-			}
+			names += ", ";
 		}
+		names += engines[i].name;
+	}
+	return names;
+}
 
-		// new community?
-		if( matches.empty() )
-		{
-			DynamicCluster dc;
-			dc.update( m_step, step_cluster_index, *cit );
-			fresh.push_back(dc);
-#ifdef DEBUG_MATCHING
-			cout << "T" << m_step << ": Birth: Community M" << (m_dynamic.size()+fresh.size()) << " from C" << step_cluster_index+1 << endl;
-#endif			
-		}
-		else
+/**
+ * Estimates how much of the index the prefix engine probes and verifies for a 
+ * step cluster of mean size, given the sizes of the communities of a step.
+ *
+ * @param sizes            sizes of the communities
+ * @param mean_size        mean size of the communities
+ * @param density          mean fraction of all nodes in each community
+ * @param fraction         matching threshold
+ * @param probe_fraction   share of the nodes of a step cluster in its prefix
+ * @param verified         share of the fronts touched by the prefix which need an intersection
+ */
+template <class Similarity>
+static void estimate_prefix( const vector<long> &sizes, const double mean_size, const double density, const Threshold &fraction, double &probe_fraction, double &verified )
+{
+	long size = max( 1L, (long)( mean_size + 0.5 ) );
+	long length = min( size, max( 1L, size - (long)Similarity::min_overlap_any( size, fraction ) + 1 ) );
+	probe_fraction = (double)length / size;
+	// a front of the same size passes the bound on its intersection when the nodes 
+	// it shares with the prefix by chance, with some margin, make up the difference
+	long need = 1;
+	while( need <= size && !Similarity::exceeds( need, size, size, fraction ) )
+	{
+		need++;
+	}
+	if( length * density * 1.5 + ( size - length ) < need )
+	{
+		verified = 0;
+		return;
+	}
+	// otherwise only the fronts of a compatible size are verified, found from a fixed sample of pairs
+	const long samples = 4096;
+	long compatible = 0;
+	for( long i = 0; i < samples; i++ )
+	{
+		long size_a = sizes[ i % sizes.size() ];
+		long size_b = sizes[ (size_t)( i * 2654435761UL ) % sizes.size() ];
+		if( Similarity::exceeds( min( size_a, size_b ), size_a, size_b, fraction ) )
 		{
-			vector<int>::const_iterator iit;
-			for( iit = matches.begin() ; iit != matches.end(); iit++ )
-			{
-				pair<int,int> p(step_cluster_index,(*iit));
-				matched_pairs.push_back(p);
-			}
+			compatible++;
 		}
 	}
+	verified = (double)compatible / samples;
+}
 
-	// Actually update existing dynamic communities now
-	set<int> matched_dynamic;
-	PairVector::const_iterator pit;
-	for( pit = matched_pairs.begin(); pit != matched_pairs.end(); pit++ )
+/**
+ * Picks a matching engine from the communities of the first step, by estimating
+ * the time each engine takes to match a step cluster of mean size, where overlap 
+ * is the mean number of communities per node:
+ *
+ * - brute compares with every front, for a fixed cost plus a cost per id;
+ * - map visits mean_size*overlap postings, then scores and sorts each front touched;
+ * - prefix ranks the nodes of the step cluster, then visits only the postings of
+ *   a prefix which shrinks as the threshold rises, but must also intersect the 
+ *   touched fronts which could still match, which is most of them when the 
+ *   communities are dense relative to the threshold, less those of incompatible size.
+ *
+ * The costs, in nanoseconds, were measured with one thread on synthetic steps of 
+ * 200 to 20000 communities, of mean size 30 to 560 and overlap 1.4 to 60, at 
+ * thresholds from 0.1 to 0.6. Brute force was slower than map in all of them, 
+ * by 3 times for 200 communities of mean size 560, and 25 times for 500 of 
+ * mean size 30, so it is only picked when nodes are in most communities. Prefix 
+ * was up to 2.2 times faster than map at 0.6, but up to 5 times slower on dense 
+ * communities at 0.3, so it is only picked when clearly cheaper.
+ *
+ * @param first_clustering   communities of the first step
+ * @param threshold          matching threshold
+ * @param similarity         similarity used for matching
+ * @param reason             explanation of the choice, for logging
+ */
+const MatchingEngine* choose_engine( const Clustering &first_clustering, const double threshold, const SimilarityMeasure similarity, string &reason )
+{
+	const double brute_cost_per_front = 95, brute_cost_per_id = 0.8;
+	const double cost_per_posting = 3, cost_per_touched = 57, prefix_cost_per_node = 40;
+	/// prefix must be cheaper than the others by this factor
+	const double prefix_margin = 0.9;
+	long count = 0, members = 0, max_size = 0;
+	vector<long> sizes;
+	Clustering::const_iterator cit;
+	for( cit = first_clustering.begin() ; cit != first_clustering.end(); cit++ )
 	{
-		int step_cluster_index = (*pit).first;
-		int dyn_cluster_index = (*pit).second;
-		// already processed this dynamic cluster?
-		if( matched_dynamic.count( dyn_cluster_index ) ) 
+		long size = (long)(*cit).size();
+		if( size < MIN_CLUSTER_SIZE )
 		{
-			DynamicCluster dc( m_dynamic[dyn_cluster_index], m_step, step_cluster_index, step_clustering[step_cluster_index] );
-			fresh.push_back(dc);
-#ifdef DEBUG_MATCHING
-			cout << "T" << m_step << ": Split: Matched C" << (step_cluster_index+1) << " to M" << (dyn_cluster_index+1) << ". Splitting to M" << (m_dynamic.size()+fresh.size()) <<  endl;
-#endif
+			continue;
 		}
-		else
+		count++;
+		members += size;
+		max_size = max( max_size, size );
+		sizes.push_back( size );
+	}
+	long nodes = assigned_count( first_clustering );
+	double mean_size = count > 0 ? (double)members/count : 0;
+	double overlap = nodes > 0 ? (double)members/nodes : 0;
+	double density = count > 0 ? overlap/count : 0;
+	double probe_fraction = 1, verified = 0;
+	if( count > 0 )
+	{
+		Threshold fraction = make_threshold( threshold );
+		switch( similarity )
 		{
-#ifdef DEBUG_MATCHING
-			cout << "T" << m_step << ": Continuation: Matched C" << (step_cluster_index+1) << " to M" << (dyn_cluster_index+1) << endl;
-#endif
-			m_dynamic[dyn_cluster_index].update( m_step, step_cluster_index, step_clustering[step_cluster_index] );
-			matched_dynamic.insert(dyn_cluster_index);
+			case SIMILARITY_OVERLAP: estimate_prefix<OverlapSimilarity>( sizes, mean_size, density, fraction, probe_fraction, verified ); break;
+			case SIMILARITY_DICE: estimate_prefix<DiceSimilarity>( sizes, mean_size, density, fraction, probe_fraction, verified ); break;
+			case SIMILARITY_COSINE: estimate_prefix<CosineSimilarity>( sizes, mean_size, density, fraction, probe_fraction, verified ); break;
+			default: estimate_prefix<JaccardSimilarity>( sizes, mean_size, density, fraction, probe_fraction, verified ); break;
 		}
 	}
-	// And finally add any new dynamic communities
-	for( dit = fresh.begin() ; dit != fresh.end(); dit++ )
+	// expected number of distinct fronts touched by the given number of postings
+	double postings = mean_size * overlap;
+	double touched = count > 0 ? count * ( 1 - exp( -postings / count ) ) : 0;
+	double prefix_touched = count > 0 ? count * ( 1 - exp( -postings * probe_fraction / count ) ) : 0;
+	double front_cost = brute_cost_per_front + brute_cost_per_id * 2 * mean_size;
+	double brute = count * front_cost;
+	double map = cost_per_posting * postings + cost_per_touched * touched;
+	double prefix = prefix_cost_per_node * mean_size + cost_per_posting * postings * probe_fraction 
+		+ cost_per_touched * prefix_touched + prefix_touched * verified * front_cost;
+	const char* name = brute < map ? "brute" : "map";
+	if( prefix < prefix_margin * min( brute, map ) )
 	{
-		m_dynamic.push_back(*dit);
+		name = "prefix";
 	}
-
-	delete[] dyn_sizes;
-	delete[] all_intersection;
-	return true;
+	stringstream ss;
+	ss << count << " communities, mean size " << mean_size << ", max size " << max_size << ", " << overlap << " communities per node; ";
+	ss << "estimated cost per step community " << brute << " for brute, " << map << " for map, " << prefix << " for prefix";
+	reason = ss.str();
+	return find_engine( name );
 }
 
-
 // ------------------------------------------------------------------------------------------
 // Utility Functions
 // ------------------------------------------------------------------------------------------
 
-int count_dead( const DynamicClustering& dynamic, const int current_step, const int death_age )
+ostream& operator<<(ostream& os, const Timeline& timeline)
 {
-	int count = 0;
-	DynamicClustering::const_iterator dit = dynamic.begin();
-	for( dit = dynamic.begin() ; dit != dynamic.end(); dit++ )
+	const TimelineStore& store = *timeline.m_store;
+	const int* clusters = store.m_clusters.empty() ? NULL : &store.m_clusters[store.m_observation_offsets[timeline.m_index]];
+	int i = 0;
+	for( uint64_t run = store.m_run_offsets[timeline.m_index]; run < store.m_run_offsets[timeline.m_index+1]; run++ )
 	{
-		if( (*dit).is_dead( current_step, death_age ) )
+		int length = timeline.run_length( run );
+		for( int k = 0; k < length; k++, i++ )
 		{
-			count++;
+			if( i > 0 )
+			{
+				os << ",";
+			}
+			os << ( store.m_run_steps[run] + k ) << "=" << (clusters[i]+1);
 		}
 	}
-	return count;
+	return os;
 }
 
-ostream& operator<<(ostream& os, const Timeline& timeline)
+ostream& operator<<(ostream& os, const DynamicCluster& dc)
 {
-	for( int i = 0; i < timeline.size(); i++ )
-	{
-		if( i > 0 )
-		{
-			os << ",";
-		}
-		os << timeline.m_history_step[i] << "=" << (timeline.m_history_cluster[i]+1);
-	}
-	return os;
+	TimelineStore single;
+	vector<int> history_step, history_cluster;
+	dc.history( history_step, history_cluster );
+	single.add( history_step, history_cluster );
+	return os << single[0];
 }
 
 void print_dynamic_clustering( DynamicClustering &dynamic )
@@ -496,6 +1883,14 @@ void print_dynamic_clustering( DynamicClustering &dynamic )
 	}
 }
 
+/**
+ * Copies the timelines of dynamic clusters into a store, in order, so that 
+ * they no longer depend on the clusterer.
+ */
+/**
+ * Writes the timelines of the dynamic clusters one at a time, so that those spilled 
+ * to the store's archive are read back one at a time rather than all together.
+ */
 bool write_timelines( const string fname, const DynamicClustering &dynamic )
 {
 	ofstream fout(fname.c_str()); 
@@ -503,28 +1898,205 @@ bool write_timelines( const string fname, const DynamicClustering &dynamic )
 	{  
     	return false; 
    }
-	DynamicClustering::const_iterator dit = dynamic.begin();
-	int dyn_index = 1;
-	for( dit = dynamic.begin() ; dit != dynamic.end(); dit++, dyn_index++ )
+	vector<int> history_step, history_cluster;
+	for( int dyn_index = 0; dyn_index < (int)dynamic.size(); dyn_index++ )
+	{
+		dynamic[dyn_index].history( history_step, history_cluster );
+		if( (int)history_step.size() != dynamic[dyn_index].size() )
+		{
+			return false;
+		}
+		fout << "M" << (dyn_index+1) << ":";
+		for( size_t i = 0; i < history_step.size(); i++ )
+		{
+			if( i > 0 )
+			{
+				fout << ",";
+			}
+			fout << history_step[i] << "=" << (history_cluster[i]+1);
+		}
+		fout << endl;
+	}
+	fout.close();
+	return !fout.fail();
+}
+
+// ------------------------------------------------------------------------------------------
+// Binary Timeline Format
+// ------------------------------------------------------------------------------------------
+//
+// A binary timeline file stores all timelines in flat arrays, using the native byte order
+// of the machine that wrote it:
+//
+//   char      magic[8]                        BINARY_TIMELINE_MAGIC
+//   uint64_t  num_timelines
+//   uint64_t  num_observations
+//   uint64_t  offsets[num_timelines+1]        start of each timeline in the arrays below
+//   int32_t   steps[num_observations]         observed steps, numbered from 1
+//   int32_t   clusters[num_observations]      step community indices, numbered from 1
+// ------------------------------------------------------------------------------------------
+
+static const char BINARY_TIMELINE_MAGIC[8] = { 'D', 'C', 'T', 'I', 'M', 'E', '0', '1' };
+/** number of values buffered before each write */
+static const size_t BINARY_TIMELINE_BLOCK = 65536;
+
+/**
+ * Writes the timelines of the dynamic clusters one at a time. The offsets follow from the 
+ * sizes of the histories, so the steps and the step clusters of each block of histories 
+ * are written to their own arrays, at their own positions in the file.
+ */
+bool write_timelines_binary( const string fname, const DynamicClustering &dynamic )
+{
+	ofstream fout( fname.c_str(), ios::out | ios::binary );
+	if(!fout) 
+	{  
+		return false; 
+	}
+	uint64_t num_timelines = (uint64_t)dynamic.size();
+	vector<uint64_t> offsets( 1, 0 );
+	offsets.reserve( dynamic.size() + 1 );
+	for( size_t dyn_index = 0; dyn_index < dynamic.size(); dyn_index++ )
+	{
+		offsets.push_back( offsets.back() + dynamic[dyn_index].size() );
+	}
+	uint64_t num_observations = offsets.back();
+	fout.write( BINARY_TIMELINE_MAGIC, sizeof(BINARY_TIMELINE_MAGIC) );
+	fout.write( (const char*)&num_timelines, sizeof(uint64_t) );
+	fout.write( (const char*)&num_observations, sizeof(uint64_t) );
+	fout.write( (const char*)&offsets[0], offsets.size()*sizeof(uint64_t) );
+	vector<uint64_t>().swap( offsets );
+	streampos steps_pos = fout.tellp();
+	streampos clusters_pos = steps_pos + (streamoff)( num_observations*sizeof(int32_t) );
+	vector<int32_t> steps_buf, clusters_buf;
+	vector<int> history_step, history_cluster;
+	for( size_t dyn_index = 0; dyn_index <= dynamic.size(); dyn_index++ )
 	{
-		fout << "M" << dyn_index << ":" << (*dit) << endl;
+		if( dyn_index < dynamic.size() )
+		{
+			dynamic[dyn_index].history( history_step, history_cluster );
+			if( (int)history_step.size() != dynamic[dyn_index].size() )
+			{
+				return false;
+			}
+			steps_buf.insert( steps_buf.end(), history_step.begin(), history_step.end() );
+			// stored from 1, as in the text format
+			for( size_t i = 0; i < history_cluster.size(); i++ )
+			{
+				clusters_buf.push_back( history_cluster[i] + 1 );
+			}
+		}
+		if( !steps_buf.empty() && ( steps_buf.size() >= BINARY_TIMELINE_BLOCK || dyn_index == dynamic.size() ) )
+		{
+			fout.seekp( steps_pos );
+			fout.write( (const char*)&steps_buf[0], steps_buf.size()*sizeof(int32_t) );
+			steps_pos = fout.tellp();
+			fout.seekp( clusters_pos );
+			fout.write( (const char*)&clusters_buf[0], clusters_buf.size()*sizeof(int32_t) );
+			clusters_pos = fout.tellp();
+			steps_buf.clear();
+			clusters_buf.clear();
+		}
 	}
 	fout.close();
+	return !fout.fail();
+}
+
+static bool read_timelines_binary( const string fname, const char* data, const size_t size, TimelineStore& timelines, int &max_step )
+{
+	const size_t header_size = sizeof(BINARY_TIMELINE_MAGIC) + 2*sizeof(uint64_t);
+	if( size < header_size )
+	{
+		cerr << "Error: Truncated binary timeline file " << fname << endl;
+		return false;
+	}
+	uint64_t num_timelines, num_observations;
+	memcpy( &num_timelines, data + sizeof(BINARY_TIMELINE_MAGIC), sizeof(uint64_t) );
+	memcpy( &num_observations, data + sizeof(BINARY_TIMELINE_MAGIC) + sizeof(uint64_t), sizeof(uint64_t) );
+	// the offsets and both arrays must fit in the remaining bytes
+	if( num_timelines >= ( size - header_size ) / sizeof(uint64_t)
+		|| num_observations > ( size - header_size - (num_timelines+1)*sizeof(uint64_t) ) / ( 2*sizeof(int32_t) ) )
+	{
+		cerr << "Error: Corrupt binary timeline file " << fname << endl;
+		return false;
+	}
+	const uint64_t* offsets = (const uint64_t*)( data + header_size );
+	const int32_t* all_steps = (const int32_t*)( offsets + num_timelines + 1 );
+	const int32_t* all_clusters = all_steps + num_observations;
+	if( offsets[0] != 0 || offsets[num_timelines] != num_observations )
+	{
+		cerr << "Error: Corrupt binary timeline file " << fname << endl;
+		return false;
+	}
+	for( uint64_t i = 0; i < num_timelines; i++ )
+	{
+		if( offsets[i+1] < offsets[i] || offsets[i+1] > num_observations )
+		{
+			cerr << "Error: Corrupt binary timeline file " << fname << endl;
+			return false;
+		}
+		if( offsets[i+1] == offsets[i] )
+		{
+			continue;
+		}
+		const int32_t* steps = all_steps + offsets[i];
+		const int32_t* cluster_indices = all_clusters + offsets[i];
+		int count = (int)( offsets[i+1] - offsets[i] );
+		for( int j = 0; j < count; j++ )
+		{
+			if( steps[j] < 1 )
+			{
+				cerr << "Error: Invalid step index '" << steps[j] << "' in timeline " << (i+1) << endl;
+				return false;
+			}
+			if( cluster_indices[j] < 1 )
+			{
+				cerr << "Error: Invalid cluster index '" << cluster_indices[j] << "' in timeline " << (i+1) << endl;
+				return false;
+			}
+			max_step = max(max_step, steps[j]);
+		}
+		timelines.add( steps, cluster_indices, count );
+	}
 	return true;
 }
 
-bool read_timelines( const string fname, vector<Timeline>& timelines, int &max_step )
+/**
+ * Reads timelines in either the text or the binary format, which is detected
+ * from the file header. Step community indices are numbered from 1.
+ */
+bool read_timelines( const string fname, TimelineStore& timelines, int &max_step )
 {
 	timelines.clear();
+	max_step = 0;
+	MappedFile mapped;
+	if( !mapped.open( fname ) )
+	{
+		return false;
+	}
+	if( mapped.size() >= sizeof(BINARY_TIMELINE_MAGIC) && memcmp( mapped.data(), BINARY_TIMELINE_MAGIC, sizeof(BINARY_TIMELINE_MAGIC) ) == 0 )
+	{
+		if( !read_timelines_binary( fname, mapped.data(), mapped.size(), timelines, max_step ) )
+		{
+			return false;
+		}
+		if( timelines.empty() )
+		{
+			cerr << "Error: file contained no valid timelines" << endl;
+			return false;
+		}
+		return true;
+	}
+	mapped.close();
 	ifstream fin(fname.c_str());
 	if(!fin) 
 	{  
     	return false; 
    } 
 	string line;
-	max_step = 0;
 	int num = 0;
 	size_t found;
+	vector<int> steps;
+	vector<int> cluster_indices;
 	while(getline(fin, line) ) 
 	{
 		num += 1;
@@ -536,8 +2108,8 @@ bool read_timelines( const string fname, vector<Timeline>& timelines, int &max_s
 		line = line.substr(found+1);
 		stringstream ss(line);
 		string temp;
-		vector<int> steps;
-		vector<int> cluster_indices;
+		steps.clear();
+		cluster_indices.clear();
 	   while (getline(ss, temp, ',')) 
 		{  
 			found = temp.find("=");
@@ -550,14 +2122,14 @@ bool read_timelines( const string fname, vector<Timeline>& timelines, int &max_s
 			stringstream is(temp.substr(0,found));
 			if( (is >> step).fail() || step < 1 )
 			{
-				cerr << "Error: Invalid step index '" << is << "' on line " << num << endl;
+				cerr << "Error: Invalid step index '" << temp.substr(0,found) << "' on line " << num << endl;
 				return false;
 			}
 			int step_cluster_index;
 			stringstream ic(temp.substr(found+1));
 			if( (ic >> step_cluster_index).fail() || step_cluster_index < 1 )
 			{
-				cerr << "Error: Invalid cluster index '" << ic << "' on line " << num << endl;
+				cerr << "Error: Invalid cluster index '" << temp.substr(found+1) << "' on line " << num << endl;
 				return false;
 			}
 			steps.push_back(step);
@@ -566,8 +2138,7 @@ bool read_timelines( const string fname, vector<Timeline>& timelines, int &max_s
 	   }
 		if( steps.size() > 0 )
 		{
-			Timeline timeline( steps, cluster_indices );
-			timelines.push_back(timeline);
+			timelines.add( steps, cluster_indices );
 		}
 	}
 	if( timelines.empty() )
@@ -577,3 +2148,130 @@ bool read_timelines( const string fname, vector<Timeline>& timelines, int &max_s
 	}
 	return true;
 }
+
+// ------------------------------------------------------------------------------------------
+// Step Index Format
+// ------------------------------------------------------------------------------------------
+//
+// A step index file stores a StepIndex next to the timelines it was built from, using the 
+// native byte order of the machine that wrote it. The counts and the size and modification 
+// time of the timeline file identify the timelines, so a changed file is indexed again:
+//
+//   char      magic[8]                        STEP_INDEX_MAGIC
+//   uint64_t  num_timelines
+//   uint64_t  num_entries                     equal to the number of observations
+//   uint64_t  num_runs                        runs of consecutive steps in all timelines
+//   uint64_t  timeline_size                   size of the timeline file in bytes
+//   uint64_t  timeline_mtime                  modification time of the timeline file, in ns
+//   uint64_t  max_step
+//   uint64_t  offsets[max_step+2]             start of each step in the arrays below
+//   int32_t   clusters[num_entries]           step community indices, as in the timelines
+//   int32_t   timelines[num_entries]          timeline indices, numbered from 0
+// ------------------------------------------------------------------------------------------
+
+static const char STEP_INDEX_MAGIC[8] = { 'D', 'C', 'S', 'I', 'D', 'X', '0', '1' };
+
+/**
+ * Finds the size and modification time of a file, or zero for both if it cannot be found.
+ */
+static void file_stamp( const string fname, uint64_t &size, uint64_t &mtime )
+{
+	struct stat st;
+	if( stat( fname.c_str(), &st ) != 0 )
+	{
+		size = mtime = 0;
+		return;
+	}
+	size = (uint64_t)st.st_size;
+	mtime = (uint64_t)st.st_mtim.tv_sec * 1000000000ULL + (uint64_t)st.st_mtim.tv_nsec;
+}
+
+bool StepIndex::write( const string fname, const string timeline_fname ) const
+{
+	ofstream fout( fname.c_str(), ios::out | ios::binary );
+	if(!fout) 
+	{  
+		return false; 
+	}
+	uint64_t num_entries = (uint64_t)m_timelines.size();
+	uint64_t max_step = (uint64_t)m_max_step;
+	uint64_t timeline_size, timeline_mtime;
+	file_stamp( timeline_fname, timeline_size, timeline_mtime );
+	fout.write( STEP_INDEX_MAGIC, sizeof(STEP_INDEX_MAGIC) );
+	fout.write( (const char*)&m_num_timelines, sizeof(uint64_t) );
+	fout.write( (const char*)&num_entries, sizeof(uint64_t) );
+	fout.write( (const char*)&m_num_runs, sizeof(uint64_t) );
+	fout.write( (const char*)&timeline_size, sizeof(uint64_t) );
+	fout.write( (const char*)&timeline_mtime, sizeof(uint64_t) );
+	fout.write( (const char*)&max_step, sizeof(uint64_t) );
+	fout.write( (const char*)&m_offsets[0], m_offsets.size()*sizeof(uint64_t) );
+	if( num_entries > 0 )
+	{
+		fout.write( (const char*)&m_clusters[0], num_entries*sizeof(int32_t) );
+		fout.write( (const char*)&m_timelines[0], num_entries*sizeof(int32_t) );
+	}
+	fout.close();
+	return !fout.fail();
+}
+
+/**
+ * Reads an index written for the given timelines. Fails if the file is missing or 
+ * corrupt, or if the timeline file or the number of timelines, observations or runs 
+ * differ from those the index was built from.
+ */
+bool StepIndex::read( const string fname, const string timeline_fname, const TimelineStore &timelines )
+{
+	MappedFile mapped;
+	if( !mapped.open( fname ) )
+	{
+		return false;
+	}
+	const size_t header_size = sizeof(STEP_INDEX_MAGIC) + 6*sizeof(uint64_t);
+	if( mapped.size() < header_size || memcmp( mapped.data(), STEP_INDEX_MAGIC, sizeof(STEP_INDEX_MAGIC) ) != 0 )
+	{
+		return false;
+	}
+	uint64_t header[6];
+	memcpy( header, mapped.data() + sizeof(STEP_INDEX_MAGIC), sizeof(header) );
+	uint64_t num_timelines = header[0], num_entries = header[1], num_runs = header[2];
+	uint64_t indexed_size = header[3], indexed_mtime = header[4], max_step = header[5];
+	uint64_t timeline_size, timeline_mtime;
+	file_stamp( timeline_fname, timeline_size, timeline_mtime );
+	if( num_timelines != (uint64_t)timelines.size() || num_entries != (uint64_t)timelines.observations() 
+		|| num_runs != (uint64_t)timelines.runs() || indexed_size != timeline_size || indexed_mtime != timeline_mtime )
+	{
+		return false;
+	}
+	if( max_step > INT_MAX - 2 || mapped.size() != header_size + ( max_step + 2 )*sizeof(uint64_t) + 2*num_entries*sizeof(int32_t) )
+	{
+		return false;
+	}
+	const uint64_t* offsets = (const uint64_t*)( mapped.data() + header_size );
+	const int32_t* clusters = (const int32_t*)( offsets + max_step + 2 );
+	const int32_t* dyn_indices = clusters + num_entries;
+	if( offsets[0] != 0 || offsets[max_step+1] != num_entries )
+	{
+		return false;
+	}
+	for( uint64_t step = 0; step <= max_step; step++ )
+	{
+		if( offsets[step+1] < offsets[step] )
+		{
+			return false;
+		}
+	}
+	for( uint64_t entry = 0; entry < num_entries; entry++ )
+	{
+		if( dyn_indices[entry] < 0 || (uint64_t)dyn_indices[entry] >= num_timelines )
+		{
+			return false;
+		}
+	}
+	m_num_timelines = num_timelines;
+	m_num_runs = num_runs;
+	m_max_step = (int)max_step;
+	m_offsets.assign( offsets, offsets + max_step + 2 );
+	m_clusters.assign( clusters, clusters + num_entries );
+	m_timelines.assign( dyn_indices, dyn_indices + num_entries );
+	return true;
+}
@@ -18,17 +18,26 @@
 #ifndef DYNAMIC_H
 #define DYNAMIC_H
 
+#include <stdint.h>
 #include "common/clustering.h"
 
+class DynamicCluster;
+
 // ------------------------------------------------------------------------------------------
 // Class: Timeline
 // ------------------------------------------------------------------------------------------
 
+class TimelineStore;
+
+/**
+ * A view of the observations of one dynamic community, held in a TimelineStore 
+ * which must outlive it. Looking up a step takes constant time.
+ */
 class Timeline
 {
 	public:
-		Timeline( vector<int> &history_step, vector<int> &history_cluster );
-		Timeline() {};
+		Timeline() : m_store(NULL), m_index(0) {};
+		Timeline( const TimelineStore *store, const int index ) : m_store(store), m_index(index) {};
 		~Timeline() {};
 
 		int last_observed() const;
@@ -41,77 +50,518 @@ class Timeline
 		// int get_cluster_index( const int step ) const; 	
 
  		int operator[] ( const int step ) const;   
+		void history( vector<int> &history_step, vector<int> &history_cluster ) const;
 		friend ostream& operator<<(ostream& os, const Timeline& dt);
 
 	protected:
-		vector<int> m_history_step;
-		vector<int> m_history_cluster; 
+		int position( const int step ) const;
+		int run_length( const uint64_t run ) const;
+
+		const TimelineStore* m_store;
+		int m_index;
+};
+
+// ------------------------------------------------------------------------------------------
+// Class: TimelineStore
+// ------------------------------------------------------------------------------------------
+
+/**
+ * All timelines in one arena, as flat arrays shared by every timeline. Steps 
+ * are run-length encoded, as most communities are observed in consecutive steps, 
+ * so each run of steps is stored as its first step and the position of that 
+ * step in the timeline's observations. Timelines of several runs also have a 
+ * bitmap of the steps they span, with the number of steps observed before each 
+ * word, so a step is found without searching the runs.
+ */
+class TimelineStore
+{
+public:
+	TimelineStore();
+
+	void clear();
+	void add( const int *history_step, const int *history_cluster, const int size );
+	void add( const vector<int> &history_step, const vector<int> &history_cluster );
+	size_t size() const { return m_run_offsets.size() - 1; }
+	bool empty() const { return size() == 0; }
+	size_t observations() const { return m_clusters.size(); }
+	size_t runs() const { return m_run_steps.size(); }
+	Timeline operator[]( const int index ) const { return Timeline( this, index ); }
+	friend class Timeline;
+	friend ostream& operator<<(ostream& os, const Timeline& dt);
+
+protected:
+	/** start of each timeline in m_clusters, followed by the number of observations */
+	vector<uint64_t> m_observation_offsets;
+	/** start of each timeline in the run arrays, followed by the number of runs */
+	vector<uint64_t> m_run_offsets;
+	/** first step of each run */
+	vector<int> m_run_steps;
+	/** position of the first step of each run among the observations of its timeline */
+	vector<int> m_run_positions;
+	/** step community index of each observation */
+	vector<int> m_clusters;
+	/** start of each timeline in the step bitmap, followed by the number of words */
+	vector<uint64_t> m_bit_offsets;
+	/** a bit for each step from the first step of a timeline, or no words if it is a single run or its steps are not increasing */
+	vector<uint64_t> m_step_bits;
+	/** number of bits set in the earlier words of the same timeline */
+	vector<int> m_step_ranks;
+};
+
+// ------------------------------------------------------------------------------------------
+// Class: StepIndex
+// ------------------------------------------------------------------------------------------
+
+/**
+ * Reverse index of a TimelineStore, listing for each step the timelines observed 
+ * in it, ordered by step community index and then by timeline. The entries for 
+ * a step are those between begin(step) and end(step).
+ */
+class StepIndex
+{
+public:
+	StepIndex() : m_max_step(0), m_num_timelines(0), m_num_runs(0) {};
+
+	void build( const TimelineStore &timelines );
+	bool read( const string fname, const string timeline_fname, const TimelineStore &timelines );
+	bool write( const string fname, const string timeline_fname ) const;
+
+	int max_step() const { return m_max_step; }
+	size_t begin( const int step ) const { return step <= m_max_step ? m_offsets[step] : m_timelines.size(); }
+	size_t end( const int step ) const { return step <= m_max_step ? m_offsets[step+1] : m_timelines.size(); }
+	/** the step community index of an entry, as stored in the timelines */
+	int cluster( const size_t entry ) const { return m_clusters[entry]; }
+	int timeline( const size_t entry ) const { return m_timelines[entry]; }
+	bool in_range( const int step, const size_t num_clusters ) const;
+
+protected:
+	int m_max_step;
+	uint64_t m_num_timelines;
+	uint64_t m_num_runs;
+	/** start of each step in the entries, from step 0, followed by the number of entries */
+	vector<uint64_t> m_offsets;
+	vector<int> m_clusters;
+	vector<int> m_timelines;
+};
+
+// ------------------------------------------------------------------------------------------
+// Class: HistoryStore
+// ------------------------------------------------------------------------------------------
+
+/** a single observation of a dynamic cluster, linked to the observation before it */
+struct HistoryNode
+{
+	int step;
+	int cluster;
+	/** index of the previous observation, or -1 if this is the first */
+	int parent;
+};
+
+/**
+ * Arena holding the histories of all dynamic clusters as a tree. Each history 
+ * is a path from its last observation back to the root, so a split shares its 
+ * ancestry with its sibling rather than copying it. Optionally, the histories 
+ * of dead dynamic clusters are moved to an append-only file, and the arena is 
+ * compacted to the nodes still reachable from the histories kept in memory.
+ */
+class HistoryStore
+{
+public:
+	HistoryStore() : m_spilled_nodes(0) {};
+	~HistoryStore();
+
+	int append( const int parent, const int step, const int step_cluster_index );
+	const HistoryNode &operator[]( const int node ) const { return m_nodes[node]; }
+	size_t size() const { return m_nodes.size(); }
+
+	bool open_archive( const string fname );
+	bool has_archive() const { return m_archive.is_open(); }
+	long long spill( const int tail, const int size );
+	bool read_spilled( const long long offset, const int size, vector<int> &history_step, vector<int> &history_cluster ) const;
+	bool should_compact() const;
+	void compact( vector<DynamicCluster> &dynamic );
+
+protected:
+	vector<HistoryNode> m_nodes;
+	/** file holding the histories of dead dynamic clusters, removed with the store */
+	mutable fstream m_archive;
+	string m_archive_fname;
+	/** number of nodes spilled since the arena was last compacted */
+	size_t m_spilled_nodes;
 };
 
 // ------------------------------------------------------------------------------------------
 // Class: DynamicCluster
 // ------------------------------------------------------------------------------------------
 
-class DynamicCluster : public Timeline
+/**
+ * A dynamic cluster refers to its last observation in a HistoryStore, which 
+ * must outlive it, and provides the same access as a Timeline. It does not 
+ * hold a copy of its front either. The front is the step cluster it was last 
+ * observed in, which the clusterer retains for as long as it can be matched.
+ */
+class DynamicCluster
 {
 public:
-	DynamicCluster() : Timeline() {};
-	DynamicCluster( DynamicCluster &sibling, const int step, const int step_cluster_index, Cluster &initial_front );
+	DynamicCluster( HistoryStore &store );
+	DynamicCluster( const DynamicCluster &sibling, const int step, const int step_cluster_index );
 	~DynamicCluster() {};
 
-	bool update( const int step, const int step_cluster_index, Cluster &initial_front );
-	Cluster &front();
+	bool update( const int step, const int step_cluster_index );
+
+	int last_observed() const;
+	int last_cluster() const;
+	int first_observed() const;
+	int size() const;
+	int consecutive_length() const;
+	bool is_observed( const int step ) const; 	
+	bool is_dead( const int step, const int death_age ) const;
+	int operator[] ( const int step ) const;
+	void history( vector<int> &history_step, vector<int> &history_cluster ) const;
+	bool spill();
+	friend ostream& operator<<(ostream& os, const DynamicCluster& dc);
+	friend class HistoryStore;
 
 protected:
-	Cluster m_front;
+	HistoryStore* m_store;
+	/** last observation in the store, or -1 if never observed */
+	int m_tail;
+	int m_size;
+	int m_first;
+	/** step and step cluster of the last observation, kept here as fronts are looked up for every match */
+	int m_last;
+	int m_last_cluster;
+	/** position of the history in the store's archive once spilled, or -1 */
+	long long m_offset;
 };
 
 typedef vector<DynamicCluster> DynamicClustering;
 typedef vector<pair<int,int> > PairVector;
 
+// ------------------------------------------------------------------------------------------
+// Similarity measures
+// ------------------------------------------------------------------------------------------
+
+enum SimilarityMeasure { SIMILARITY_JACCARD, SIMILARITY_OVERLAP, SIMILARITY_DICE, SIMILARITY_COSINE };
+
+/** matching threshold as the fraction num/den, so similarities can be tested without division */
+struct Threshold
+{
+	long long num;
+	long long den;
+};
+
+/* 
+ * Each measure tests whether the similarity of two sets exceeds a threshold, 
+ * given the size of their intersection, in integer arithmetic. The scoring 
+ * loops are instantiated once per measure. Each also bounds the intersection 
+ * a set needs with any other set to exceed the threshold, for prefix filtering.
+ */
+
+struct JaccardSimilarity
+{
+	static inline bool exceeds( const long long inter, const long long size_a, const long long size_b, const Threshold &t )
+	{
+		return inter * t.den > t.num * ( size_a + size_b - inter );
+	}
+	/** intersection is at most size_a, so needs inter > t*size_a */
+	static inline long long min_overlap_any( const long long size_a, const Threshold &t )
+	{
+		return t.num * size_a / t.den + 1;
+	}
+};
+
+struct OverlapSimilarity
+{
+	static inline bool exceeds( const long long inter, const long long size_a, const long long size_b, const Threshold &t )
+	{
+		return inter * t.den > t.num * min( size_a, size_b );
+	}
+	/** a single shared node is enough when the other set has one node */
+	static inline long long min_overlap_any( const long long, const Threshold & )
+	{
+		return 1;
+	}
+};
+
+struct DiceSimilarity
+{
+	static inline bool exceeds( const long long inter, const long long size_a, const long long size_b, const Threshold &t )
+	{
+		return 2 * inter * t.den > t.num * ( size_a + size_b );
+	}
+	/** similarity is at most 2*inter/(size_a+inter), so needs inter > t*size_a/(2-t) */
+	static inline long long min_overlap_any( const long long size_a, const Threshold &t )
+	{
+		return t.num * size_a / ( 2 * t.den - t.num ) + 1;
+	}
+};
+
+struct CosineSimilarity
+{
+	/** inter/sqrt(size_a*size_b) > num/den, squared on both sides */
+	static inline bool exceeds( const long long inter, const long long size_a, const long long size_b, const Threshold &t )
+	{
+		unsigned __int128 lhs = (unsigned __int128)( inter * inter ) * (unsigned __int128)( t.den * t.den );
+		unsigned __int128 rhs = (unsigned __int128)( t.num * t.num ) * (unsigned __int128)( size_a * size_b );
+		return lhs > rhs;
+	}
+	/** similarity is at most sqrt(inter/size_a), so needs inter > t*t*size_a */
+	static inline long long min_overlap_any( const long long size_a, const Threshold &t )
+	{
+		unsigned __int128 num = (unsigned __int128)( t.num * t.num ) * (unsigned __int128)size_a;
+		return (long long)( num / (unsigned __int128)( t.den * t.den ) ) + 1;
+	}
+};
+
+bool parse_similarity( const string name, SimilarityMeasure &measure );
+const char* similarity_name( const SimilarityMeasure measure );
+Threshold make_threshold( const double threshold );
+
 // ------------------------------------------------------------------------------------------
 // Class: MatchingDynamicClusterer
 // ------------------------------------------------------------------------------------------
 
+/** working storage used by one thread when scoring step clusters */
+struct MatchBuffer
+{
+	vector<int> counts;
+	vector<int> touched;
+	vector<unsigned long long> keys;
+};
+
+/** counts describing the dynamic clusters after a step */
+struct TrackingStatus
+{
+	/** all dynamic clusters so far */
+	int total;
+	/** dynamic clusters which can still be matched */
+	int live;
+	int dead;
+	/** changes in the step, where births include step clusters matching no dynamic cluster */
+	int births;
+	int splits;
+	int continuations;
+};
+
 class MatchingDynamicClusterer
 {
 public:
 	MatchingDynamicClusterer( const double matching_threshold, const int death_age );
+	virtual ~MatchingDynamicClusterer() {};
 	
-	virtual bool add_clustering( Clustering &step_clustering );
+	bool add_clustering( Clustering &step_clustering );
 	DynamicClustering &find_clusters();
+	void set_num_threads( const int num_threads );
+	void set_similarity( const SimilarityMeasure measure );
+	bool set_archive( const string fname );
+	TrackingStatus status() const;
+	virtual string summary() const;
 	
 protected:
-	virtual void find_matches( const Cluster &step_cluster, vector<int> &matches );
+	const Cluster &front( const int dyn_index ) const;
+	int window_slot( const int step ) const;
+	Clustering &retain( Clustering &step_clustering );
+	void observed( const int dyn_index );
+	void expire_dead();
+	virtual bool find_matches( const Cluster &step_cluster, vector<int> &matches, MatchBuffer &buffer ) const;
+	template <class Similarity>
+	void score_fronts( const Cluster &step_cluster, vector<int> &matches ) const;
+	virtual void begin_step( const Clustering &step_clustering );
+	virtual void front_added( const int dyn_index );
+	virtual void front_removed( const int dyn_index );
+	virtual void matched( const Clustering &step_clustering, const vector< vector<int> > &step_matches, const vector<char> &eligible );
 	bool bootstrap( Clustering &step_clustering );
+	void match_all( const Clustering &step_clustering, vector< vector<int> > &step_matches, vector<char> &eligible ) const;
+	static void* match_thread( void* arg );
 	
 	/** matching threshold */
 	double m_threshold;
+	/** matching threshold, as a fraction */
+	Threshold m_fraction;
+	/** similarity between step clusters and fronts */
+	SimilarityMeasure m_similarity;
 	/** age at which communities die if not observed */
 	int m_death_age;
 	/** set of dynamic clusters */
 	DynamicClustering m_dynamic;
+	/** observations of all dynamic clusters */
+	HistoryStore m_history;
+	/** the dynamic clusters which are not dead, in ascending order */
+	vector<int> m_live;
+	/** for each step, the dynamic clusters observed in it, which may die death_age steps later */
+	vector< vector<int> > m_expiry;
+	/** number of dynamic clusters removed from the live set */
+	int m_num_dead;
+	/** number of dynamic clusters born, split off and continued in the current step */
+	int m_num_births;
+	int m_num_splits;
+	int m_num_continuations;
+	/** the step clusterings which may hold a front, the last death_age+1 steps, or all steps if communities never die */
+	vector<Clustering> m_window;
 	/** current step number */
 	int m_step;
+	/** number of threads scoring step clusters */
+	int m_num_threads;
+};
+
+// ------------------------------------------------------------------------------------------
+// Class: IndexedMatchingDynamicClusterer
+// ------------------------------------------------------------------------------------------
+
+/**
+ * Base for engines which keep an index of the live fronts, updated as fronts 
+ * are replaced and removed when their dynamic cluster dies.
+ */
+class IndexedMatchingDynamicClusterer : public MatchingDynamicClusterer
+{
+public:
+	IndexedMatchingDynamicClusterer( const double matching_threshold, const int death_age );
+
+protected:
+	void set_front_size( const int dyn_index, const long size );
+
+	/** size of the indexed front of each dynamic cluster, or 0 if not indexed */
+	vector<long> m_front_sizes;
 };
 
 // ------------------------------------------------------------------------------------------
 // Class: MapMatchingDynamicClusterer
 // ------------------------------------------------------------------------------------------
 
-class MapMatchingDynamicClusterer : public MatchingDynamicClusterer
+class MapMatchingDynamicClusterer : public IndexedMatchingDynamicClusterer
 {
 public:
 	MapMatchingDynamicClusterer( const double matching_threshold, const int death_age );
-	
-	virtual bool add_clustering( Clustering &step_clustering );
+
+protected:
+	virtual bool find_matches( const Cluster &step_cluster, vector<int> &matches, MatchBuffer &buffer ) const;
+	template <class Similarity>
+	void score_touched( const long size_step, vector<int> &matches, MatchBuffer &buffer ) const;
+	virtual void begin_step( const Clustering &step_clustering );
+	virtual void front_added( const int dyn_index );
+	virtual void front_removed( const int dyn_index );
+	void remove_stale();
+
+	/** for each node, the live dynamic clusters whose front contains it */
+	vector< vector<int> > m_postings;
+	/** dynamic clusters whose entries in the index are stale, flagged and listed */
+	vector<char> m_stale;
+	vector<int> m_stale_clusters;
+	/** nodes of the stale fronts, flagged and listed */
+	vector<char> m_node_stale;
+	vector<NODE_ID> m_stale_nodes;
+};
+
+// ------------------------------------------------------------------------------------------
+// Class: PrefixMatchingDynamicClusterer
+// ------------------------------------------------------------------------------------------
+
+/**
+ * Probes the index with only a prefix of each step cluster, taking its nodes 
+ * contained in the fewest fronts first. A front can only exceed the threshold
+ * if it shares a node with the prefix, and only if it shares enough of them 
+ * for the rest of the step cluster to make up the difference. Fronts of the 
+ * wrong size are skipped without counting, and the intersection of the rest
+ * is counted only until the threshold can no longer be reached.
+ */
+class PrefixMatchingDynamicClusterer : public MapMatchingDynamicClusterer
+{
+public:
+	PrefixMatchingDynamicClusterer( const double matching_threshold, const int death_age );
+
+protected:
+	virtual bool find_matches( const Cluster &step_cluster, vector<int> &matches, MatchBuffer &buffer ) const;
+	template <class Similarity>
+	void match_prefix( const Cluster &step_cluster, vector<int> &matches, MatchBuffer &buffer ) const;
+};
+
+// ------------------------------------------------------------------------------------------
+// Class: LshMatchingDynamicClusterer
+// ------------------------------------------------------------------------------------------
+
+/**
+ * Approximate engine for very large steps. Each front is summarised by a 
+ * MinHash signature, split into bands of rows; fronts are bucketed by the hash
+ * of each band, and a step cluster is only compared with the fronts sharing a 
+ * bucket with it in some band. Candidates are verified exactly, so every match 
+ * found is a true match, but some true matches may be missed. More bands, or 
+ * fewer rows per band, find more of them at a higher cost.
+ */
+class LshMatchingDynamicClusterer : public IndexedMatchingDynamicClusterer
+{
+public:
+	LshMatchingDynamicClusterer( const double matching_threshold, const int death_age, const int bands, const int rows, const int recall_sample );
+	virtual string summary() const;
+
+protected:
+	virtual bool find_matches( const Cluster &step_cluster, vector<int> &matches, MatchBuffer &buffer ) const;
+	template <class Similarity>
+	void verify_candidates( const Cluster &step_cluster, vector<int> &matches, MatchBuffer &buffer ) const;
+	virtual void begin_step( const Clustering &step_clustering );
+	virtual void front_added( const int dyn_index );
+	virtual void front_removed( const int dyn_index );
+	virtual void matched( const Clustering &step_clustering, const vector< vector<int> > &step_matches, const vector<char> &eligible );
+	void band_keys( const Cluster &cluster, unsigned long long* keys ) const;
+
+	int m_bands;
+	int m_rows;
+	/** multiplier and increment of each MinHash function */
+	vector<unsigned long long> m_hash_a;
+	vector<unsigned long long> m_hash_b;
+	/** hash of the original identifier of each node, which does not depend on the order nodes were read */
+	vector<unsigned long long> m_node_hashes;
+	/** for each band, the live dynamic clusters by the hash of their band */
+	vector< map<unsigned long long, vector<int> > > m_buckets;
+	/** band hashes of the indexed front of each dynamic cluster */
+	vector<unsigned long long> m_front_keys;
+	/** number of step clusters per step checked against exact matching */
+	int m_recall_sample;
+	long m_sampled;
+	long m_exact_matches;
+	long m_found_matches;
 };
 
+// ------------------------------------------------------------------------------------------
+// Matching engines
+// ------------------------------------------------------------------------------------------
+
+/** settings used only by some engines */
+struct EngineOptions
+{
+	/** number of LSH bands */
+	int bands;
+	/** number of MinHash values in each LSH band */
+	int rows;
+	/** number of step clusters per step checked against exact matching, to measure recall */
+	int recall_sample;
+};
+
+typedef MatchingDynamicClusterer* (*EngineFactory)( const double matching_threshold, const int death_age, const EngineOptions &options );
+
+/**
+ * A named way of matching step clusters to dynamic clusters. The brute, map and prefix 
+ * engines are exact and find the same matches. The lsh engine is approximate and can miss 
+ * matches, with a recall set by --bands and --rows and measured with --recall.
+ */
+struct MatchingEngine
+{
+	const char* name;
+	const char* description;
+	EngineFactory create;
+	/** can the engine be picked by the 'auto' engine? */
+	bool automatic;
+};
+
+const MatchingEngine* find_engine( const string name );
+string engine_names();
+const MatchingEngine* choose_engine( const Clustering &first_clustering, const double threshold, const SimilarityMeasure similarity, string &reason );
+
 // ------------------------------------------------------------------------------------------
 
-int count_dead( const DynamicClustering& dynamic, const int current_step, const int death_age );
-bool read_timelines( const string fname, vector<Timeline>& timelines, int &max_step );
+bool read_timelines( const string fname, TimelineStore& timelines, int &max_step );
 bool write_timelines( const string fname, const DynamicClustering &dynamic );
+bool write_timelines_binary( const string fname, const DynamicClustering &dynamic );
 void print_dynamic_clustering( DynamicClustering &dynamic );
 
 // ------------------------------------------------------------------------------------------
@@ -18,6 +18,7 @@
 #include "settings.h"
 #include "common/standard.h"
 #include "common/clustering.h"
+#include "common/steps.h"
 #include "dynamic.h"
 #include "extras.h"
 
@@ -27,12 +28,26 @@ int main(int argc, char *argv[])
 	{
 		cerr << "Error: Invalid number of arguments." << endl;
 		cerr << "Usage: " << argv[0] << " [timeline_file] step1_communities step2_communities..." << endl;
+		cerr << "       " << argv[0] << " [timeline_file] --archive archive_file" << endl;
 		return -1;
 	}
+	StepSource steps;
+	if( argc > 2 && string(argv[2]) == "--archive" )
+	{
+		if( argc != 4 || !steps.open_archive( string(argv[3]) ) )
+		{
+			cerr << "Error: Failed to open step archive" << endl;
+			return -1;
+		}
+	}
+	else
+	{
+		steps.set_files( argc - 2, argv + 2 );
+	}
 		
 	// Read timeline
 	string timeline_fname(argv[1]);
-	vector<Timeline> timelines;
+	TimelineStore timelines;
 	int max_step;
 	cout << "* Loading timelines from " << timeline_fname << endl;
 	if( !read_timelines( timeline_fname, timelines, max_step ) )
@@ -41,6 +56,8 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 	cout << "Read " << timelines.size() << " dynamic community timelines" << endl;
+	StepIndex step_index;
+	step_index.build( timelines );
 	
 	/// Create storage
 	Clustering union_clustering;
@@ -54,8 +71,7 @@ int main(int argc, char *argv[])
 	}
 	
 	/// Process each set of step communities
-	vector<Timeline>::iterator timeit;
-	int supplied_steps = argc - 2;
+	int supplied_steps = steps.size();
 	if( supplied_steps < max_step )
 	{
 		cerr << "Error: incorrect number of step files specified (" << supplied_steps << " < " << max_step << ")" << endl;
@@ -63,33 +79,30 @@ int main(int argc, char *argv[])
 	}
 	for( int step = 1; step <= max_step; step++ )
 	{
-		string fname(argv[step+1]);
-		ifstream in(argv[step+1]);
-		if(in.is_open() == false) 
-		{
-			cerr << "Error: Step communities file "<<fname<<" not found"<< endl;
-			return -1;
-		}
+		string fname = steps.name(step);
 		cout << "* Loading step " << step << "/" << max_step << " from " << fname << " ..." << endl;
 		Clustering step_clustering;
-		if( !read_clustering( fname, DEFAULT_DELIM, step_clustering ) )
+		if( !steps.read( step, step_clustering ) )
 		{
-			cerr << "Error: Failed to read communities from file " << fname << endl;
+			cerr << "Error: Failed to read communities from " << fname << endl;
 			return -1;
 		}
 		cout << "Found " << step_clustering.size() << " non-empty step communities" << endl;
-		// create the set
-		for( int dyn_index = 0; dyn_index < timelines.size(); dyn_index++ )
+		if( !step_index.in_range( step, step_clustering.size() ) )
 		{
-			int step_cluster_index = timelines[dyn_index][step] - 1;
-			if( step_cluster_index >= 0 )
-			{
-				union_clustering[dyn_index].insert(step_clustering[step_cluster_index].begin(), step_clustering[step_cluster_index].end());
-			}
+			cerr << "Error: Timelines refer to step communities missing from " << fname << endl;
+			return -1;
+		}
+		// create the set from the timelines observed in this step
+		for( size_t entry = step_index.begin(step); entry < step_index.end(step); entry++ )
+		{
+			int dyn_index = step_index.timeline(entry);
+			int step_cluster_index = step_index.cluster(entry) - 1;
+			union_clustering[dyn_index].insert(step_clustering[step_cluster_index].begin(), step_clustering[step_cluster_index].end());
 		}
 	}
 	
-	set<NODE> all_nodes;
+	set<NODE_ID> all_nodes;
 	for( int dyn_index = 0; dyn_index < timelines.size(); dyn_index++ )
 	{
 		Cluster::const_iterator it;
@@ -101,9 +114,9 @@ int main(int argc, char *argv[])
 	long total_nodes = (long)all_nodes.size();
 	printf("%ld nodes assigned in total.\n", total_nodes);
 	
-	set<NODE> assigned;
-	set<NODE> present_comms;
-	map<NODE,int> nmap;
+	set<NODE_ID> assigned;
+	set<NODE_ID> present_comms;
+	map<NODE_ID,int> nmap;
 	for( int i = max_step; i > 0; i--)
 	{
 		for( int dyn_index = 0; dyn_index < timelines.size(); dyn_index++ )
@@ -113,7 +126,7 @@ int main(int argc, char *argv[])
 				Cluster::const_iterator it;
 				for( it = union_clustering[dyn_index].begin() ; it != union_clustering[dyn_index].end(); it++ )
 				{
-					NODE node = *it;
+					NODE_ID node = *it;
 					assigned.insert( node );
 					if( nmap.find( node ) == nmap.end() )
 					{
@@ -133,7 +146,7 @@ int main(int argc, char *argv[])
 		double frac_nodes = 100*(((double)assigned_count)/total_nodes);		
 		printf( "  Present in at least %d consecutive step(s): %d communities (%.1f%%), %ld nodes (%.1f%%)\n", i, comm_count, frac_comm, assigned_count, frac_nodes );
 		
-		map<NODE,int>::const_iterator it;
+		map<NODE_ID,int>::const_iterator it;
 		double total = 0.0;
 		int max_per_comm = 0;
 		for ( it = nmap.begin() ; it != nmap.end(); it++ )
@@ -0,0 +1,94 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// ------------------------------------------------------------------------------------------
+// Step community archive packing tool
+// ------------------------------------------------------------------------------------------
+
+#include "settings.h"
+#include "common/standard.h"
+#include "common/clustering.h"
+#include "common/steps.h"
+
+int main(int argc, char *argv[])
+{
+	if( argc < 2 )
+	{
+		cerr << "Error: Invalid number of arguments." << endl;
+		cerr << "Usage: " << argv[0] << " archive_file step1_communities step2_communities..." << endl;
+		cerr << "       " << argv[0] << " archive_file < step_file_list" << endl;
+		return -1;
+	}
+	string archive_fname(argv[1]);
+
+	/// Step file paths come from the command line, or one per line on stdin
+	vector<string> fnames;
+	if( argc > 2 )
+	{
+		fnames.assign( argv + 2, argv + argc );
+	}
+	else
+	{
+		string line;
+		while( getline(cin, line) )
+		{
+			if( !line.empty() )
+			{
+				fnames.push_back(line);
+			}
+		}
+	}
+	int max_step = (int)fnames.size();
+	if( max_step < 1 )
+	{
+		cerr << "Error: At least one file containing step communities should be specified" << endl;
+		return -1;
+	}
+
+	StepArchiveWriter writer;
+	if( !writer.open( archive_fname, max_step ) )
+	{
+		cerr << "Error: Cannot write file " << archive_fname << endl;
+		return -1;
+	}
+	for( int step = 1; step <= max_step; step++ )
+	{
+		string fname = fnames[step-1];
+		cout << "* Loading step " << step << "/" << max_step << " from " << fname << " ..." << endl;
+		Clustering step_clustering;
+		if( !read_clustering_mmap( fname, DEFAULT_DELIM, step_clustering ) )
+		{
+			cerr << "Error: Failed to read communities from file " << fname << endl;
+			return -1;
+		}
+		cout << "Found " << step_clustering.size() << " non-empty step communities" << endl;
+		if( !writer.add( step_clustering ) )
+		{
+			cerr << "Error: Cannot write file " << archive_fname << endl;
+			return -1;
+		}
+	}
+	cout << "Writing " << max_step << " steps to " << archive_fname << endl;
+	if( !writer.close() )
+	{
+		cerr << "Error: Cannot write file " << archive_fname << endl;
+		return -1;
+	}
+
+	cout << "Done." << endl;
+	return 0;
+}
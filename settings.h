@@ -19,6 +19,8 @@
 #define SETTINGS_H
 
 typedef long NODE;
+/** dense internal node identifier, assigned to each distinct NODE when it is first read */
+typedef unsigned int NODE_ID;
 
 //----------------------------------
 // General clustering settings
@@ -31,11 +33,9 @@ typedef long NODE;
 // Matching settings
 //----------------------------------
 
-#define MAP_MATCHING 1
 #define DEFAULT_DEATH_AGE 3
 #define LONG_LIVED 2
 #define MIN_PERSIST_LENGTH 2
-//#define SIM_OVERLAP 1
 //#define DEBUG_MATCHING 1
 //#define DEBUG_DYNAMIC 1
 
@@ -18,6 +18,7 @@
 #include "settings.h"
 #include "common/standard.h"
 #include "common/clustering.h"
+#include "common/steps.h"
 #include "dynamic.h"
 #include "extras.h"
 
@@ -27,20 +28,33 @@ int main(int argc, char *argv[])
 	{
 		cerr << "Error: Invalid number of arguments." << endl;
 		cerr << "Usage: " << argv[0] << " step1_communities step2_communities..." << endl;
+		cerr << "       " << argv[0] << " --archive archive_file" << endl;
 		return -1;
 	}
-	int max_step = argc - 1;
+	StepSource steps;
+	if( string(argv[1]) == "--archive" )
+	{
+		if( argc != 3 || !steps.open_archive( string(argv[2]) ) )
+		{
+			cerr << "Error: Failed to open step archive" << endl;
+			return -1;
+		}
+	}
+	else
+	{
+		steps.set_files( argc - 1, argv + 1 );
+	}
+	int max_step = steps.size();
 
 	// Get all nodes
-	set<NODE> assigned;
+	set<NODE_ID> assigned;
 	for( int step = 1; step <= max_step; step++ )
 	{
-		string fname(argv[step]);
-		ifstream in(argv[step]);
+		string fname = steps.name(step);
 		Clustering clustering;
-		if( !read_clustering( fname, DEFAULT_DELIM, clustering ) )
+		if( !steps.read( step, clustering ) )
 		{
-			cerr << "Error: Failed to read communities from file " << fname << endl;
+			cerr << "Error: Failed to read communities from " << fname << endl;
 			return -1;
 		}
 		cout << "Step " << step << ": " << clustering.size() << " non-empty step communities" << endl;
@@ -58,12 +72,11 @@ int main(int argc, char *argv[])
 	cout << "Total nodes assigned: " << n << endl;
 	for( int step = 1; step <= max_step; step++ )
 	{
-		string fname(argv[step]);
-		ifstream in(argv[step]);
+		string fname = steps.name(step);
 		Clustering clustering;
-		if( !read_clustering( fname, DEFAULT_DELIM, clustering ) )
+		if( !steps.read( step, clustering ) )
 		{
-			cerr << "Error: Failed to read communities from file " << fname << endl;
+			cerr << "Error: Failed to read communities from " << fname << endl;
 			return -1;
 		}
 		long step_assigned = assigned_count(clustering);
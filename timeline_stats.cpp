@@ -32,7 +32,7 @@ int main(int argc, char *argv[])
 	
 	// Read timeline
 	string timeline_fname(argv[1]);
-	vector<Timeline> timelines;
+	TimelineStore timelines;
 	int max_step;
 	cout << "* Loading timelines from " << timeline_fname << endl;
 	if( !read_timelines( timeline_fname, timelines, max_step ) )
@@ -50,25 +50,25 @@ int main(int argc, char *argv[])
 		consec[i] = 0;
 	}
 
-	vector<Timeline>::const_iterator cit = timelines.begin();
 	int long_lived = 0;
 	int intermittent = 0;
 	int dead = 0;
-	for( cit = timelines.begin() ; cit != timelines.end(); cit++)
+	for( int dyn_index = 0; dyn_index < (int)timelines.size(); dyn_index++ )
 	{
-		int seen = (int)((*cit).size());
+		Timeline timeline = timelines[dyn_index];
+		int seen = (int)(timeline.size());
 		if( seen > LONG_LIVED )
 		{
 			long_lived++;
 		}
-		int seenConsec = ((*cit).consecutive_length());
+		int seenConsec = (timeline.consecutive_length());
 		freq[seen]++;
 		consec[seenConsec]++;
-		if( seen < max_step && (*cit).last_observed() - (*cit).first_observed() > 1 )
+		if( seen < max_step && timeline.last_observed() - timeline.first_observed() > 1 )
 		{
 			intermittent++;
 		}
-		if( (*cit).is_dead( max_step, DEFAULT_DEATH_AGE ) )
+		if( timeline.is_dead( max_step, DEFAULT_DEATH_AGE ) )
 		{
 			dead++;
 		}
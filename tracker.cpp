@@ -24,7 +24,9 @@
 #include "settings.h"
 #include "common/standard.h"
 #include "common/clustering.h"
+#include "common/steps.h"
 #include "common/util.h"
+#include "common/intersect.h"
 #include "dynamic.h"
 #include "extras.h"
 #include "trackerargs.h"
@@ -37,7 +39,25 @@ int main(int argc, char *argv[])
 	{
 		exit(1);
 	}
-	int max_step = args_info.inputs_num;
+	StepSource steps;
+	if( args_info.archive_arg != NULL && strlen(args_info.archive_arg) > 0 )
+	{
+		if( args_info.inputs_num > 0 )
+		{
+			cerr << "Error: Step communities should be specified either as files or as an archive, not both" << endl;
+			exit(1);
+		}
+		if( !steps.open_archive( string(args_info.archive_arg) ) )
+		{
+			cerr << "Error: Failed to open step archive " << args_info.archive_arg << endl;
+			exit(1);
+		}
+	}
+	else
+	{
+		steps.set_files( args_info.inputs_num, args_info.inputs );
+	}
+	int max_step = steps.size();
 	if( max_step < 1 )
 	{
 		cerr << "Error: At least one file containing step communities should be specified" << endl;
@@ -60,38 +80,71 @@ int main(int argc, char *argv[])
 		prefix = string(args_info.output_arg);
 	}
 	int death_age = args_info.death_arg;
-	
-#ifdef MAP_MATCHING
-	cout << "* Applying map-based dynamic tracking (threshold=" << matching_threshold << ")" << endl;
-	MapMatchingDynamicClusterer clusterer(matching_threshold,death_age);
-#else
-	cout << "* Applying dynamic tracking (threshold=" << matching_threshold << ")" << endl;
-	MatchingDynamicClusterer clusterer(matching_threshold,death_age);
-#endif
-
-#ifdef SIM_OVERLAP
-	cout << "* Using binary overlap similarity" <<  endl;
-#else
-	cout << "* Using Jaccard similarity" << endl;
-#endif
+	int num_readers = args_info.readers_arg;
+	if( num_readers < 0 )
+	{
+		cerr << "Error: Invalid number of reader threads: " << num_readers << endl;
+		exit(1);
+	}
+	SimilarityMeasure similarity;
+	if( !parse_similarity( args_info.similarity_arg, similarity ) )
+	{
+		cerr << "Error: Invalid similarity measure: " << args_info.similarity_arg << ". Value should be one of jaccard, overlap, dice or cosine." << endl;
+		exit(1);
+	}
+	int num_threads = args_info.threads_arg;
+	if( num_threads < 1 )
+	{
+		cerr << "Error: Invalid number of matching threads: " << num_threads << endl;
+		exit(1);
+	}
+	string engine_name = args_info.engine_arg;
+	const MatchingEngine* engine = NULL;
+	if( engine_name != "auto" )
+	{
+		engine = find_engine( engine_name );
+		if( engine == NULL )
+		{
+			cerr << "Error: Invalid matching engine: " << engine_name << ". Value should be auto or one of " << engine_names() << "." << endl;
+			exit(1);
+		}
+	}
+	EngineOptions engine_options;
+	engine_options.bands = args_info.bands_arg;
+	engine_options.rows = args_info.rows_arg;
+	engine_options.recall_sample = args_info.recall_arg;
+	if( engine_options.bands < 1 || engine_options.rows < 1 || engine_options.recall_sample < 0 )
+	{
+		cerr << "Error: Invalid LSH settings: " << engine_options.bands << " bands, " << engine_options.rows << " rows, recall sample of " << engine_options.recall_sample << endl;
+		exit(1);
+	}
+	string spill_fname;
+	if( args_info.spill_arg != NULL && strlen(args_info.spill_arg) > 0 )
+	{
+		spill_fname = string(args_info.spill_arg);
+	}
+	if( num_threads > 1 )
+	{
+		cout << "* Scoring step communities with " << num_threads << " threads" << endl;
+	}
+	cout << "* Using " << similarity_name( similarity ) << " similarity" << endl;
+	cout << "* Counting intersections with the " << intersection_kernel_name() << " kernel" << endl;
 
-	/// Process each time step
+	/// Process each time step, while upcoming steps are read in the background
+	MatchingDynamicClusterer* clusterer = NULL;
 	clock_t start = clock();
+	StepPrefetcher prefetcher( steps, num_readers );
 	for ( int i = 0; i < max_step; ++i )
 	{
 		int step = i+1;
-		string fname(args_info.inputs[i]);
-		ifstream in(args_info.inputs[i]);
-		if( in.is_open() == false ) 
-		{
-			cerr << "Error: Step communities file "<<fname<<" not found"<< endl;
-			return -1;
-		}
+		string fname = steps.name(step);
 		cout << "* Loading step " << step << "/" << max_step << " from " << fname << " ..." << endl;
 		Clustering step_clustering;
-		if( !read_clustering( fname, DEFAULT_DELIM, step_clustering ) )
+		if( !prefetcher.next( step_clustering ) )
 		{
-			cerr << "Error: Failed to read communities from file " << fname << endl;
+			cerr << "Error: Failed to read communities from " << fname << endl;
+			// also removes any spill file
+			delete clusterer;
 			return -1;
 		}
 		cout << "Found " << step_clustering.size() << " non-empty step communities";
@@ -99,28 +152,75 @@ int main(int argc, char *argv[])
 		cout << ", " << assigned_count(step_clustering) << " nodes assigned to a cluster, " << overlapping_count(step_clustering) << " nodes assigned to multiple clusters.";
 #endif
 		cout << endl;
+		/// The engine is created once the first step is known, so that 'auto' can look at it
+		if( clusterer == NULL )
+		{
+			if( engine == NULL )
+			{
+				string reason;
+				engine = choose_engine( step_clustering, matching_threshold, similarity, reason );
+				cout << "* Chose " << engine->name << " engine: " << reason << endl;
+			}
+			cout << "* Applying " << engine->description << " dynamic tracking (threshold=" << matching_threshold << ")" << endl;
+			clusterer = engine->create( matching_threshold, death_age, engine_options );
+			clusterer->set_num_threads( num_threads );
+			clusterer->set_similarity( similarity );
+			if( !spill_fname.empty() )
+			{
+				if( !clusterer->set_archive( spill_fname ) )
+				{
+					cerr << "Error: Cannot create spill file " << spill_fname << endl;
+					delete clusterer;
+					return -1;
+				}
+				cout << "* Moving timelines of dead dynamic communities to " << spill_fname << endl;
+			}
+		}
 		cout << "Matching to existing dynamic communities ..." << endl;
-		clusterer.add_clustering( step_clustering );
-		DynamicClustering dynamic = clusterer.find_clusters();
-		cout << "Currently " << dynamic.size() << " dynamic communities, " << count_dead(dynamic, step, death_age) << " now dead." << endl;
+		clusterer->add_clustering( step_clustering );
+		TrackingStatus status = clusterer->status();
+		cout << "Currently " << status.total << " dynamic communities, " << status.dead << " now dead." << endl;
+		cout << "Step had " << status.continuations << " continuations, " << status.splits << " splits and " << status.births << " births." << endl;
 	}
 	
 	/// Find final dynamic clusters and find results
-	DynamicClustering dynamic = clusterer.find_clusters();
+	TrackingStatus status = clusterer->status();
+	string summary = clusterer->summary();
+	if( !summary.empty() )
+	{
+		cout << "* " << summary << endl;
+	}
 	clock_t end = clock();
-	cout << "* Overall: Tracked " << dynamic.size() << " dynamic communities, " << count_dead(dynamic, max_step+death_age, death_age) << " now dead." << endl;
+	// once tracking ends, all communities not observed in the last step will die
+	cout << "* Overall: Tracked " << status.total << " dynamic communities, " << ( status.total - status.births - status.splits - status.continuations ) << " now dead." << endl;
 	cout << "Total time: " << diff_clock(end,start)/1000 << " sec"<<endl;
 			
-	/// Write the results
+	/// Write the results, straight from the dynamic clusters and any spill file, which is removed with the clusterer
 #ifdef ENABLE_WRITING			
-	string fname = prefix + ".timeline";
-	cout << "Writing timeline to " << fname << endl;
-	if( !write_timelines(fname, dynamic) )
+	if( args_info.binary_given )
+	{
+		string fname = prefix + ".btimeline";
+		cout << "Writing binary timeline to " << fname << endl;
+		if( !write_timelines_binary(fname, clusterer->find_clusters()) )
+		{
+			cerr << "Error: Cannot write file " << fname << endl;
+			delete clusterer;
+			return -1;
+		}
+	}
+	else
 	{
-		cerr << "Error: Cannot write file " << fname << endl;
-		return -1;
+		string fname = prefix + ".timeline";
+		cout << "Writing timeline to " << fname << endl;
+		if( !write_timelines(fname, clusterer->find_clusters()) )
+		{
+			cerr << "Error: Cannot write file " << fname << endl;
+			delete clusterer;
+			return -1;
+		}
 	}
 #endif
+	delete clusterer;
 			
 	cout << "Done." << endl;
 	return 0;
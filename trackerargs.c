@@ -28,11 +28,21 @@ const char *tracker_args_info_usage = "Usage: tracker [OPTIONS]... [STEP_COMMUNI
 const char *tracker_args_info_description = "Dynamic community tracking tool";
 
 const char *tracker_args_info_help[] = {
-  "  -h, --help              Print help and exit",
-  "  -V, --version           Print version and exit",
-  "  -t, --threshold=DOUBLE  community matching threshold (in range 0 to 1)  \n                            (default=`0.1')",
-  "  -o, --output=PREFIX     prefix for output files",
-  "  -d, --death=INT         number of steps after which a dynamic community is \n                            declared 'dead'  (default=`3')",
+  "  -h, --help                Print help and exit",
+  "  -V, --version             Print version and exit",
+  "  -t, --threshold=DOUBLE    community matching threshold (in range 0 to 1)  \n                              (default=`0.1')",
+  "  -o, --output=PREFIX       prefix for output files",
+  "  -d, --death=INT           number of steps after which a dynamic community is \n                              declared 'dead'  (default=`3')",
+  "  -a, --archive=FILEPATH    step community archive created by the pack tool, \n                              used instead of STEP_COMMUNITIES",
+  "  -b, --binary              write timelines in the binary timeline format \n                              (PREFIX.btimeline)",
+  "  -r, --readers=INT         number of threads reading upcoming step files while \n                              the current step is matched (0 to read each step \n                              in turn)  (default=`1')",
+  "  -j, --threads=INT         number of threads scoring step communities against \n                              the current dynamic communities  (default=`1')",
+  "  -s, --similarity=MEASURE  similarity between step communities and dynamic \n                              communities (jaccard, overlap, dice or cosine)  \n                              (default=`jaccard')",
+  "  -e, --engine=ENGINE       engine matching step communities to dynamic \n                              communities (auto, brute, map, prefix or lsh)  \n                              (default=`auto')",
+  "  -B, --bands=INT           number of bands of MinHash values used by the lsh \n                              engine  (default=`20')",
+  "  -R, --rows=INT            number of MinHash values in each band used by the \n                              lsh engine  (default=`3')",
+  "  -c, --recall=INT          number of step communities per step matched exactly \n                              to measure the recall of the lsh engine (0 to \n                              disable)  (default=`100')",
+  "  -S, --spill=FILEPATH      file to which the timelines of dead dynamic \n                              communities are moved while tracking, removed \n                              once the timelines are written",
     0
 };
 
@@ -63,6 +73,16 @@ void clear_given (struct tracker_args_info *args_info)
   args_info->threshold_given = 0 ;
   args_info->output_given = 0 ;
   args_info->death_given = 0 ;
+  args_info->archive_given = 0 ;
+  args_info->binary_given = 0 ;
+  args_info->readers_given = 0 ;
+  args_info->threads_given = 0 ;
+  args_info->similarity_given = 0 ;
+  args_info->engine_given = 0 ;
+  args_info->bands_given = 0 ;
+  args_info->rows_given = 0 ;
+  args_info->recall_given = 0 ;
+  args_info->spill_given = 0 ;
 }
 
 static
@@ -74,6 +94,24 @@ void clear_args (struct tracker_args_info *args_info)
   args_info->output_orig = NULL;
   args_info->death_arg = 3;
   args_info->death_orig = NULL;
+  args_info->archive_arg = NULL;
+  args_info->archive_orig = NULL;
+  args_info->readers_arg = 1;
+  args_info->readers_orig = NULL;
+  args_info->threads_arg = 1;
+  args_info->threads_orig = NULL;
+  args_info->similarity_arg = gengetopt_strdup ("jaccard");
+  args_info->similarity_orig = NULL;
+  args_info->engine_arg = gengetopt_strdup ("auto");
+  args_info->engine_orig = NULL;
+  args_info->bands_arg = 20;
+  args_info->bands_orig = NULL;
+  args_info->rows_arg = 3;
+  args_info->rows_orig = NULL;
+  args_info->recall_arg = 100;
+  args_info->recall_orig = NULL;
+  args_info->spill_arg = NULL;
+  args_info->spill_orig = NULL;
   
 }
 
@@ -87,6 +125,16 @@ void init_args_info(struct tracker_args_info *args_info)
   args_info->threshold_help = tracker_args_info_help[2] ;
   args_info->output_help = tracker_args_info_help[3] ;
   args_info->death_help = tracker_args_info_help[4] ;
+  args_info->archive_help = tracker_args_info_help[5] ;
+  args_info->binary_help = tracker_args_info_help[6] ;
+  args_info->readers_help = tracker_args_info_help[7] ;
+  args_info->threads_help = tracker_args_info_help[8] ;
+  args_info->similarity_help = tracker_args_info_help[9] ;
+  args_info->engine_help = tracker_args_info_help[10] ;
+  args_info->bands_help = tracker_args_info_help[11] ;
+  args_info->rows_help = tracker_args_info_help[12] ;
+  args_info->recall_help = tracker_args_info_help[13] ;
+  args_info->spill_help = tracker_args_info_help[14] ;
   
 }
 
@@ -172,6 +220,19 @@ cmdline_parser_release (struct tracker_args_info *args_info)
   free_string_field (&(args_info->output_arg));
   free_string_field (&(args_info->output_orig));
   free_string_field (&(args_info->death_orig));
+  free_string_field (&(args_info->archive_arg));
+  free_string_field (&(args_info->archive_orig));
+  free_string_field (&(args_info->readers_orig));
+  free_string_field (&(args_info->threads_orig));
+  free_string_field (&(args_info->similarity_arg));
+  free_string_field (&(args_info->similarity_orig));
+  free_string_field (&(args_info->engine_arg));
+  free_string_field (&(args_info->engine_orig));
+  free_string_field (&(args_info->bands_orig));
+  free_string_field (&(args_info->rows_orig));
+  free_string_field (&(args_info->recall_orig));
+  free_string_field (&(args_info->spill_arg));
+  free_string_field (&(args_info->spill_orig));
   
   
   for (i = 0; i < args_info->inputs_num; ++i)
@@ -216,6 +277,26 @@ cmdline_parser_dump(FILE *outfile, struct tracker_args_info *args_info)
     write_into_file(outfile, "output", args_info->output_orig, 0);
   if (args_info->death_given)
     write_into_file(outfile, "death", args_info->death_orig, 0);
+  if (args_info->archive_given)
+    write_into_file(outfile, "archive", args_info->archive_orig, 0);
+  if (args_info->binary_given)
+    write_into_file(outfile, "binary", 0, 0 );
+  if (args_info->readers_given)
+    write_into_file(outfile, "readers", args_info->readers_orig, 0);
+  if (args_info->threads_given)
+    write_into_file(outfile, "threads", args_info->threads_orig, 0);
+  if (args_info->similarity_given)
+    write_into_file(outfile, "similarity", args_info->similarity_orig, 0);
+  if (args_info->engine_given)
+    write_into_file(outfile, "engine", args_info->engine_orig, 0);
+  if (args_info->bands_given)
+    write_into_file(outfile, "bands", args_info->bands_orig, 0);
+  if (args_info->rows_given)
+    write_into_file(outfile, "rows", args_info->rows_orig, 0);
+  if (args_info->recall_given)
+    write_into_file(outfile, "recall", args_info->recall_orig, 0);
+  if (args_info->spill_given)
+    write_into_file(outfile, "spill", args_info->spill_orig, 0);
   
 
   i = EXIT_SUCCESS;
@@ -469,10 +550,20 @@ cmdline_parser_internal (int argc, char * const *argv, struct tracker_args_info
         { "threshold",	1, NULL, 't' },
         { "output",	1, NULL, 'o' },
         { "death",	1, NULL, 'd' },
+        { "archive",	1, NULL, 'a' },
+        { "binary",	0, NULL, 'b' },
+        { "readers",	1, NULL, 'r' },
+        { "threads",	1, NULL, 'j' },
+        { "similarity",	1, NULL, 's' },
+        { "engine",	1, NULL, 'e' },
+        { "bands",	1, NULL, 'B' },
+        { "rows",	1, NULL, 'R' },
+        { "recall",	1, NULL, 'c' },
+        { "spill",	1, NULL, 'S' },
         { NULL,	0, NULL, 0 }
       };
 
-      c = getopt_long (argc, argv, "hVt:o:d:", long_options, &option_index);
+      c = getopt_long (argc, argv, "hVt:o:d:a:br:j:s:e:B:R:c:S:", long_options, &option_index);
 
       if (c == -1) break;	/* Exit from `while (1)' loop.  */
 
@@ -524,6 +615,126 @@ cmdline_parser_internal (int argc, char * const *argv, struct tracker_args_info
             goto failure;
         
           break;
+        case 'a':	/* step community archive created by the pack tool, used instead of STEP_COMMUNITIES.  */
+        
+        
+          if (update_arg( (void *)&(args_info->archive_arg), 
+               &(args_info->archive_orig), &(args_info->archive_given),
+              &(local_args_info.archive_given), optarg, 0, 0, ARG_STRING,
+              check_ambiguity, override, 0, 0,
+              "archive", 'a',
+              additional_error))
+            goto failure;
+        
+          break;
+        case 'b':	/* write timelines in the binary timeline format (PREFIX.btimeline).  */
+        
+        
+          if (update_arg( 0 , 
+               0 , &(args_info->binary_given),
+              &(local_args_info.binary_given), optarg, 0, 0, ARG_NO,
+              check_ambiguity, override, 0, 0,
+              "binary", 'b',
+              additional_error))
+            goto failure;
+        
+          break;
+        case 'r':	/* number of threads reading upcoming step files while the current step is matched (0 to read each step in turn).  */
+        
+        
+          if (update_arg( (void *)&(args_info->readers_arg), 
+               &(args_info->readers_orig), &(args_info->readers_given),
+              &(local_args_info.readers_given), optarg, 0, "1", ARG_INT,
+              check_ambiguity, override, 0, 0,
+              "readers", 'r',
+              additional_error))
+            goto failure;
+        
+          break;
+        case 'j':	/* number of threads scoring step communities against the current dynamic communities.  */
+        
+        
+          if (update_arg( (void *)&(args_info->threads_arg), 
+               &(args_info->threads_orig), &(args_info->threads_given),
+              &(local_args_info.threads_given), optarg, 0, "1", ARG_INT,
+              check_ambiguity, override, 0, 0,
+              "threads", 'j',
+              additional_error))
+            goto failure;
+        
+          break;
+        case 's':	/* similarity between step communities and dynamic communities (jaccard, overlap, dice or cosine).  */
+        
+        
+          if (update_arg( (void *)&(args_info->similarity_arg), 
+               &(args_info->similarity_orig), &(args_info->similarity_given),
+              &(local_args_info.similarity_given), optarg, 0, "jaccard", ARG_STRING,
+              check_ambiguity, override, 0, 0,
+              "similarity", 's',
+              additional_error))
+            goto failure;
+        
+          break;
+        case 'e':	/* engine matching step communities to dynamic communities (auto, brute, map, prefix or lsh).  */
+        
+        
+          if (update_arg( (void *)&(args_info->engine_arg), 
+               &(args_info->engine_orig), &(args_info->engine_given),
+              &(local_args_info.engine_given), optarg, 0, "auto", ARG_STRING,
+              check_ambiguity, override, 0, 0,
+              "engine", 'e',
+              additional_error))
+            goto failure;
+        
+          break;
+        case 'B':	/* number of bands of MinHash values used by the lsh engine.  */
+        
+        
+          if (update_arg( (void *)&(args_info->bands_arg), 
+               &(args_info->bands_orig), &(args_info->bands_given),
+              &(local_args_info.bands_given), optarg, 0, "20", ARG_INT,
+              check_ambiguity, override, 0, 0,
+              "bands", 'B',
+              additional_error))
+            goto failure;
+        
+          break;
+        case 'R':	/* number of MinHash values in each band used by the lsh engine.  */
+        
+        
+          if (update_arg( (void *)&(args_info->rows_arg), 
+               &(args_info->rows_orig), &(args_info->rows_given),
+              &(local_args_info.rows_given), optarg, 0, "3", ARG_INT,
+              check_ambiguity, override, 0, 0,
+              "rows", 'R',
+              additional_error))
+            goto failure;
+        
+          break;
+        case 'c':	/* number of step communities per step matched exactly to measure the recall of the lsh engine (0 to disable).  */
+        
+        
+          if (update_arg( (void *)&(args_info->recall_arg), 
+               &(args_info->recall_orig), &(args_info->recall_given),
+              &(local_args_info.recall_given), optarg, 0, "100", ARG_INT,
+              check_ambiguity, override, 0, 0,
+              "recall", 'c',
+              additional_error))
+            goto failure;
+        
+          break;
+        case 'S':	/* file to which the timelines of dead dynamic communities are moved while tracking, removed once the timelines are written.  */
+        
+        
+          if (update_arg( (void *)&(args_info->spill_arg), 
+               &(args_info->spill_orig), &(args_info->spill_given),
+              &(local_args_info.spill_given), optarg, 0, 0, ARG_STRING,
+              check_ambiguity, override, 0, 0,
+              "spill", 'S',
+              additional_error))
+            goto failure;
+        
+          break;
 
         case 0:	/* Long option with no short option */
         case '?':	/* Invalid option.  */
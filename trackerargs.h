@@ -43,12 +43,50 @@ struct tracker_args_info
   int death_arg;	/**< @brief number of steps after which a dynamic community is declared 'dead' (default='3').  */
   char * death_orig;	/**< @brief number of steps after which a dynamic community is declared 'dead' original value given at command line.  */
   const char *death_help; /**< @brief number of steps after which a dynamic community is declared 'dead' help description.  */
+  char * archive_arg;	/**< @brief step community archive created by the pack tool, used instead of STEP_COMMUNITIES.  */
+  char * archive_orig;	/**< @brief step community archive created by the pack tool, used instead of STEP_COMMUNITIES original value given at command line.  */
+  const char *archive_help; /**< @brief step community archive created by the pack tool, used instead of STEP_COMMUNITIES help description.  */
+  const char *binary_help; /**< @brief write timelines in the binary timeline format (PREFIX.btimeline) help description.  */
+  int readers_arg;	/**< @brief number of threads reading upcoming step files while the current step is matched (0 to read each step in turn) (default='1').  */
+  char * readers_orig;	/**< @brief number of threads reading upcoming step files while the current step is matched (0 to read each step in turn) original value given at command line.  */
+  const char *readers_help; /**< @brief number of threads reading upcoming step files while the current step is matched (0 to read each step in turn) help description.  */
+  int threads_arg;	/**< @brief number of threads scoring step communities against the current dynamic communities (default='1').  */
+  char * threads_orig;	/**< @brief number of threads scoring step communities against the current dynamic communities original value given at command line.  */
+  const char *threads_help; /**< @brief number of threads scoring step communities against the current dynamic communities help description.  */
+  char * similarity_arg;	/**< @brief similarity between step communities and dynamic communities (jaccard, overlap, dice or cosine) (default='jaccard').  */
+  char * similarity_orig;	/**< @brief similarity between step communities and dynamic communities (jaccard, overlap, dice or cosine) original value given at command line.  */
+  const char *similarity_help; /**< @brief similarity between step communities and dynamic communities (jaccard, overlap, dice or cosine) help description.  */
+  char * engine_arg;	/**< @brief engine matching step communities to dynamic communities (auto, brute, map, prefix or lsh) (default='auto').  */
+  char * engine_orig;	/**< @brief engine matching step communities to dynamic communities (auto, brute, map, prefix or lsh) original value given at command line.  */
+  const char *engine_help; /**< @brief engine matching step communities to dynamic communities (auto, brute, map, prefix or lsh) help description.  */
+  int bands_arg;	/**< @brief number of bands of MinHash values used by the lsh engine (default='20').  */
+  char * bands_orig;	/**< @brief number of bands of MinHash values used by the lsh engine original value given at command line.  */
+  const char *bands_help; /**< @brief number of bands of MinHash values used by the lsh engine help description.  */
+  int rows_arg;	/**< @brief number of MinHash values in each band used by the lsh engine (default='3').  */
+  char * rows_orig;	/**< @brief number of MinHash values in each band used by the lsh engine original value given at command line.  */
+  const char *rows_help; /**< @brief number of MinHash values in each band used by the lsh engine help description.  */
+  int recall_arg;	/**< @brief number of step communities per step matched exactly to measure the recall of the lsh engine (0 to disable) (default='100').  */
+  char * recall_orig;	/**< @brief number of step communities per step matched exactly to measure the recall of the lsh engine (0 to disable) original value given at command line.  */
+  const char *recall_help; /**< @brief number of step communities per step matched exactly to measure the recall of the lsh engine (0 to disable) help description.  */
+  char * spill_arg;	/**< @brief file to which the timelines of dead dynamic communities are moved while tracking, removed once the timelines are written.  */
+  char * spill_orig;	/**< @brief file to which the timelines of dead dynamic communities are moved while tracking, removed once the timelines are written original value given at command line.  */
+  const char *spill_help; /**< @brief file to which the timelines of dead dynamic communities are moved while tracking, removed once the timelines are written help description.  */
   
   unsigned int help_given ;	/**< @brief Whether help was given.  */
   unsigned int version_given ;	/**< @brief Whether version was given.  */
   unsigned int threshold_given ;	/**< @brief Whether threshold was given.  */
   unsigned int output_given ;	/**< @brief Whether output was given.  */
   unsigned int death_given ;	/**< @brief Whether death was given.  */
+  unsigned int archive_given ;	/**< @brief Whether archive was given.  */
+  unsigned int binary_given ;	/**< @brief Whether binary was given.  */
+  unsigned int readers_given ;	/**< @brief Whether readers was given.  */
+  unsigned int threads_given ;	/**< @brief Whether threads was given.  */
+  unsigned int similarity_given ;	/**< @brief Whether similarity was given.  */
+  unsigned int engine_given ;	/**< @brief Whether engine was given.  */
+  unsigned int bands_given ;	/**< @brief Whether bands was given.  */
+  unsigned int rows_given ;	/**< @brief Whether rows was given.  */
+  unsigned int recall_given ;	/**< @brief Whether recall was given.  */
+  unsigned int spill_given ;	/**< @brief Whether spill was given.  */
 
   char **inputs ; /**< @brief unamed options (options without names) */
   unsigned inputs_num ; /**< @brief unamed options number */